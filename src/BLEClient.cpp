@@ -24,10 +24,13 @@
 
 #include "bluefruit.h"
 #include "debug.h"
+#include "ridelog.h"
 #include "BLEClient.h"
 
 BLEClientCharacteristicPower::BLEClientCharacteristicPower(void)
     : BLEClientCharacteristic(UUID16_CHR_CYCLING_POWER_MEASUREMENT) {
+    _last_activity = 0;
+    _inst_power = 0;
 }
 
 int BLEClientCharacteristicPower::process(uint8_t *data, uint16_t len) {
@@ -38,6 +41,10 @@ int BLEClientCharacteristicPower::process(uint8_t *data, uint16_t len) {
     _inst_power = data[2];
     _inst_power |= data[3] << 8;
 
+    if (_inst_power > 0) {
+        _last_activity = hal_millis();
+    }
+
     DEBUG_PRINT("Power flags = 0x%X : Power = %d W\n", flags, _inst_power);
     return 0;
 }
@@ -85,12 +92,16 @@ bool BLEClientPower::disableNotify(void) {
 
 void BLEClientPower::_callback(BLEClientCharacteristic* chr,
   uint8_t* data, uint16_t len) {
+    ridelog_trace(RIDELOG_TRACE_CPS, data, len);
     reinterpret_cast<BLEClientCharacteristicPower*>(chr)->process(data, len);
 }
 
 BLEClientCharacteristicSandC::BLEClientCharacteristicSandC(void)
     : BLEClientCharacteristic(UUID16_CHR_CSC_MEASUREMENT) {
     _valid = 0;
+    _last_activity = 0;
+    _last_update = 0;
+    _last_update_micros = 0;
     _wheel_circ = 67;
     // :_wheel_circ = 2096;
 
@@ -106,6 +117,7 @@ BLEClientCharacteristicSandC::BLEClientCharacteristicSandC(void)
 
     _wheel_speed = 0;
     _crank_speed = 0;
+    _crank_millis = 0;
 }
 
 float BLEClientCharacteristicSandC::calculate(void) {
@@ -129,6 +141,26 @@ float BLEClientCharacteristicSandC::calculate(void) {
   return _wheel_speed;
 }
 
+float BLEClientCharacteristicSandC::calculateCadence(void) {
+  // This routine calculates the cadence (rpm)
+  uint16_t _revs = _crank_revs - _last_crank_revs;
+  uint16_t _time = _crank_event_time - _last_crank_event_time;
+
+  _last_crank_revs = _crank_revs;
+  _last_crank_event_time = _crank_event_time;
+
+  if (_time != 0) {
+    _crank_speed = static_cast<float>(_revs) * 60;
+    _crank_speed /= static_cast<float>(_time) / 1024;
+    _crank_millis = hal_millis();
+  } else if ((hal_millis() - _crank_millis) > SANDC_CADENCE_TIMEOUT) {
+    // Hold the last value between crank events
+    _crank_speed = 0;
+  }
+
+  return _crank_speed;
+}
+
 int BLEClientCharacteristicSandC::process(uint8_t *data, uint16_t len) {
     // First set the valid flag to zero
     _valid = 0;
@@ -140,6 +172,9 @@ int BLEClientCharacteristicSandC::process(uint8_t *data, uint16_t len) {
     uint8_t flags = data[0];
     int doff = 1;
 
+    uint32_t _prev_wheel_revs = _wheel_revs;
+    uint16_t _prev_crank_revs = _crank_revs;
+
     if (flags & SANDC_SPEED) {
         // We have wheel rev data
         // Check length
@@ -169,7 +204,7 @@ int BLEClientCharacteristicSandC::process(uint8_t *data, uint16_t len) {
         _crank_revs |= data[doff++] << 8;
 
         _crank_event_time = data[doff++];
-        _crank_event_time |= data[doff++];
+        _crank_event_time |= data[doff++] << 8;
     }
 
     if (flags & SANDC_SPEED) {
@@ -182,6 +217,13 @@ int BLEClientCharacteristicSandC::process(uint8_t *data, uint16_t len) {
           _crank_revs, _crank_event_time);
     }
 
+    if ((_wheel_revs != _prev_wheel_revs)
+        || (_crank_revs != _prev_crank_revs)) {
+        _last_activity = hal_millis();
+    }
+
+    _last_update = hal_millis();
+    _last_update_micros = hal_micros();
     _valid = flags;
     return 0;
 }
@@ -229,5 +271,6 @@ bool BLEClientSandC::disableNotify(void) {
 
 void BLEClientSandC::_callback(BLEClientCharacteristic* chr,
   uint8_t* data, uint16_t len) {
+    ridelog_trace(RIDELOG_TRACE_CSC, data, len);
     reinterpret_cast<BLEClientCharacteristicSandC*>(chr)->process(data, len);
 }
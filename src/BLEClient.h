@@ -31,12 +31,22 @@
 
 #define SANDC_SPEED         0x01
 #define SANDC_CADENCE       0x02
+#define SANDC_CADENCE_TIMEOUT   3000
 
 class BLEClientCharacteristicPower : public BLEClientCharacteristic {
  public:
   BLEClientCharacteristicPower(void);
   int process(uint8_t *data, uint16_t len);
+  unsigned long getLastActivity(void) {
+    return _last_activity;
+  }
+  int16_t getInstPower(void) {
+    return _inst_power;
+  }
+
  private:
+  unsigned long _last_activity;
+
   float _wheel_circ;
   float _wheel_speed;
   float _crank_speed;
@@ -58,9 +68,23 @@ class BLEClientCharacteristicSandC : public BLEClientCharacteristic {
   BLEClientCharacteristicSandC(void);
   int process(uint8_t *data, uint16_t len);
   float calculate(void);
+  float calculateCadence(void);
+  unsigned long getLastActivity(void) {
+    return _last_activity;
+  }
+  unsigned long getLastUpdate(void) {
+    return _last_update;
+  }
+  unsigned long getLastUpdateMicros(void) {
+    return _last_update_micros;
+  }
 
  private:
   bool _valid;
+  unsigned long _last_activity;
+  unsigned long _last_update;
+  unsigned long _last_update_micros;
+  unsigned long _crank_millis;
 
   float _wheel_circ;
   float _wheel_speed;
@@ -87,6 +111,10 @@ class BLEClientPower : public BLEClientService {
   bool enableNotify(void);
   bool disableNotify(void);
 
+  BLEClientCharacteristicPower* getPower(void) {
+    return &_power;
+  }
+
  private:
   BLEClientCharacteristicPower _power;
   static void _callback(BLEClientCharacteristic* chr,
@@ -0,0 +1,186 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include "hal.h"
+#include "BLEClient.h"
+#include "config.h"
+#include "control.h"
+#include "triac.h"
+#include "levelbar.h"
+#include "bench.h"
+
+typedef void (*bench_func_t)(int i);
+
+// Results go here so the calls can not be optimised away
+volatile uint32_t bench_sink = 0;
+
+static BLEClientCharacteristicSandC bench_csc;
+static BLEClientCharacteristicPower bench_cps;
+
+static uint8_t bench_csc_data[BENCH_INPUTS][11];
+static uint16_t bench_csc_len[BENCH_INPUTS];
+static uint8_t bench_cps_data[BENCH_INPUTS][8];
+static float bench_speed[BENCH_INPUTS];
+
+static void bench_put16(uint8_t *p, uint16_t v) {
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+static void bench_inputs(void) {
+  // A ride at 5 - 35 mph and 90 rpm. Most notifications carry both
+  // wheel and crank data, some only one of them.
+  uint32_t wheel_revs = 0;
+  uint16_t wheel_time = 0;
+  uint16_t crank_revs = 0;
+  uint16_t crank_time = 0;
+
+  for (int i = 0; i < BENCH_INPUTS; i++) {
+    static const uint8_t flags[4] = {
+      SANDC_SPEED | SANDC_CADENCE, SANDC_SPEED,
+      SANDC_SPEED | SANDC_CADENCE, SANDC_CADENCE
+    };
+    uint8_t *p = bench_csc_data[i];
+    int len = 0;
+    p[len++] = flags[i % 4];
+
+    wheel_revs += 1 + (i % 7);
+    wheel_time += 1024;
+    crank_revs += 1 + (i % 3);
+    crank_time += 683;
+    if (p[0] & SANDC_SPEED) {
+      bench_put16(&p[len], wheel_revs & 0xFFFF);
+      bench_put16(&p[len + 2], wheel_revs >> 16);
+      bench_put16(&p[len + 4], wheel_time);
+      len += 6;
+    }
+    if (p[0] & SANDC_CADENCE) {
+      bench_put16(&p[len], crank_revs);
+      bench_put16(&p[len + 2], crank_time);
+      len += 4;
+    }
+    bench_csc_len[i] = len;
+
+    uint8_t *q = bench_cps_data[i];
+    bench_put16(&q[0], 0);
+    bench_put16(&q[2], 50 + i * 7);
+    bench_put16(&q[4], wheel_revs & 0xFFFF);
+    bench_put16(&q[6], wheel_time);
+
+    bench_speed[i] = 40.0 * i / BENCH_INPUTS;
+  }
+}
+
+static void bench_empty(int i) {
+  bench_sink = i;
+}
+
+static void bench_csc_process(int i) {
+  bench_sink = bench_csc.process(bench_csc_data[i], bench_csc_len[i]);
+}
+
+static void bench_cps_process(int i) {
+  bench_sink = bench_cps.process(bench_cps_data[i], 8);
+}
+
+static void bench_csc_calculate(int i) {
+  // calculate() returns early without a new sample, so each call
+  // includes the process() of the next notification
+  bench_csc.process(bench_csc_data[i], bench_csc_len[i]);
+  bench_sink = static_cast<uint32_t>(bench_csc.calculate());
+}
+
+static void bench_control_calculate(int i) {
+  bench_sink = control_calculate(bench_speed[i]);
+}
+
+static void bench_triac_set_output(int i) {
+  triac_set_output(i * 4, 255 - i * 4);
+  bench_sink = i;
+}
+
+static void bench_levelbar_draw(int i) {
+  uint32_t bar[INDICATOR_BAR_PIXELS];
+  levelbar_draw(bar, config_get()->indicator_colormap, i * 4, i);
+  bench_sink = bar[INDICATOR_BAR_PIXELS - 1];
+}
+
+static uint32_t bench_time(bench_func_t func) {
+  // Cycles of the fastest batch
+  uint32_t best = 0xFFFFFFFF;
+  for (int r = 0; r < BENCH_REPEATS; r++) {
+    uint32_t start = hal_cycles();
+    for (int n = 0; n < BENCH_BATCH; n++) {
+      func(n % BENCH_INPUTS);
+    }
+    uint32_t cycles = hal_cycles() - start;
+    if (cycles < best) {
+      best = cycles;
+    }
+  }
+
+  return best;
+}
+
+static void bench_report(const char *name, uint32_t cycles) {
+  float per_op = static_cast<float>(cycles) / BENCH_BATCH;
+  float ns = per_op * 1000 / hal_cycles_per_us();
+  char buf[80];
+  int len = snprintf(buf, sizeof(buf), "bench,%s,%d,%.1f,%.1f\n",
+                     name, BENCH_BATCH * BENCH_REPEATS, per_op, ns);
+  hal_console_write(buf, len);
+}
+
+void bench_run(void) {
+  static const struct {
+    const char *name;
+    bench_func_t func;
+  } benches[] = {
+    {"csc_process", bench_csc_process},
+    {"cps_process", bench_cps_process},
+    {"csc_calculate", bench_csc_calculate},
+    {"control_calculate", bench_control_calculate},
+    {"triac_set_output", bench_triac_set_output},
+    {"levelbar_draw", bench_levelbar_draw},
+  };
+
+  hal_cycles_setup();
+  bench_inputs();
+
+  static const char header[] = "bench,name,ops,cycles_per_op,ns_per_op\n";
+  hal_console_write(header, sizeof(header) - 1);
+
+  uint32_t overhead = bench_time(bench_empty);
+  bench_report("call", overhead);
+
+  for (unsigned i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+    uint32_t cycles = bench_time(benches[i].func);
+    cycles = (cycles > overhead) ? (cycles - overhead) : 0;
+    bench_report(benches[i].name, cycles);
+  }
+
+  // Leave the fans off
+  triac_set_output(0, 0);
+}
@@ -0,0 +1,51 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_BENCH_H_
+#define SRC_BENCH_H_
+
+// Microbenchmarks of the code on the sensor to fan path: the CSC and
+// CPS parsers, the speed estimate, the control law, triac_set_output()
+// and the level bar mapping. Each is timed with hal_cycles() over
+// BENCH_REPEATS batches of BENCH_BATCH calls on a fixed set of inputs,
+// and the fastest batch is reported so interrupts only add to the
+// slower ones. The cost of the empty call is taken off.
+//
+// Results are written to the console as CSV, one line per benchmark:
+//
+//   bench,name,ops,cycles_per_op,ns_per_op
+//
+// so "grep ^bench," pulls them out of the rest of the output. On the
+// nRF52 the cycles are DWT cycles, on the host they are ns.
+//
+// Built by env:bench (nRF52, runs from setup()) and env:bench_native.
+
+#define BENCH_BATCH             256   // Calls timed together
+#define BENCH_REPEATS           32    // Batches per benchmark
+#define BENCH_INPUTS            64    // Inputs, used in turn
+
+// Needs the config set up, the fan outputs are changed
+void bench_run(void);
+
+#endif  // SRC_BENCH_H_
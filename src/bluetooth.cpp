@@ -28,6 +28,7 @@
 #include "bluetooth.h"
 #include "indicator.h"
 #include "config.h"
+#include "broadcast.h"
 
 BLEUart bleuart;
 BLEClientSandC  clientSandC;
@@ -40,48 +41,318 @@ uint8_t bluetooth_mac_whitelist[][6] = {{0x99, 0xE8, 0x2C, 0xFB, 0x62, 0xFC},
                                         // {0x94, 0x4F, 0xD9, 0xDA, 0x39, 0xDD},
                                         {0x00, 0x00, 0x00, 0x00, 0x00, 0x00}};
 
-static void defaultCallback(const char *cmd, const int cmd_len, void * ctx) {}
+static void defaultCallback(uint16_t conn_handle, void * ctx) {}
 bluetoothFuncPtr_t uart_usr_rx_callback = defaultCallback;
 void* uart_usr_rx_callback_ptr = NULL;
 
-bool check_mac_whitelist(uint8_t *mac) {
-  int i = 0;
-  uint8_t zero[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-  while (memcmp(bluetooth_mac_whitelist[i], zero, 6)) {
-    if (!memcmp(bluetooth_mac_whitelist[i], mac, 6)) {
+// Set of MAC addresses we will connect to. This is built from the config
+// and the whitelist so the scan callback only has to do a hashed lookup
+// for each advertisement rather than a memcmp against every entry.
+
+typedef struct {
+  ble_gap_addr_t addr;
+  uint8_t flags;
+} mac_set_entry;
+
+mac_set_entry mac_set[MAC_SET_SIZE];
+
+// Scan scheduler state
+
+volatile int scan_state = SCAN_STATE_IDLE;
+volatile bool scan_reschedule = true;
+unsigned long scan_state_millis = 0;
+unsigned long scan_schedule_millis = 0;
+int direct_connect_next = 0;
+
+// Connection parameter policy state for each link
+
+typedef struct {
+  uint8_t role;
+  uint8_t state;
+  unsigned long millis;
+} conn_link;
+
+conn_link conn_links[BT_MAX_LINKS];
+unsigned long conn_policy_millis = 0;
+volatile uint16_t uart_conn_handle = BLE_CONN_HANDLE_INVALID;
+
+static const uint8_t mac_zero[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+static inline int mac_set_hash(const uint8_t *mac) {
+  uint32_t h = mac[0] | (mac[1] << 8) | (mac[2] << 16) | (mac[3] << 24);
+  h ^= mac[4] | (mac[5] << 8);
+  h *= 2654435761UL;
+  return h >> (32 - MAC_SET_BITS);
+}
+
+mac_set_entry* mac_set_lookup(const uint8_t *mac) {
+  int i = mac_set_hash(mac);
+  for (int n = 0; n < MAC_SET_SIZE; n++) {
+    mac_set_entry *e = &mac_set[i];
+    if (!e->flags) {
+      return NULL;
+    }
+    if (!memcmp(e->addr.addr, mac, 6)) {
+      return e;
+    }
+    i = (i + 1) & (MAC_SET_SIZE - 1);
+  }
+
+  return NULL;
+}
+
+bool mac_set_insert(const uint8_t *mac, uint8_t flags) {
+  if (!memcmp(mac, mac_zero, 6)) {
+    return false;
+  }
+
+  int i = mac_set_hash(mac);
+  for (int n = 0; n < MAC_SET_SIZE; n++) {
+    mac_set_entry *e = &mac_set[i];
+    if (!e->flags) {
+      memcpy(e->addr.addr, mac, 6);
+      // Random static addresses have the two most significant bits set,
+      // use this as our best guess until we see an advertisement.
+      if ((mac[5] & 0xC0) == 0xC0) {
+        e->addr.addr_type = BLE_GAP_ADDR_TYPE_RANDOM_STATIC;
+      } else {
+        e->addr.addr_type = BLE_GAP_ADDR_TYPE_PUBLIC;
+      }
+      e->flags = flags;
+      return true;
+    }
+    if (!memcmp(e->addr.addr, mac, 6)) {
+      e->flags |= flags;
       return true;
     }
-    i++;
+    i = (i + 1) & (MAC_SET_SIZE - 1);
   }
 
+  DEBUG_COMMENT("MAC set is full.\n");
   return false;
 }
 
-bool check_mac_config(uint8_t *mac) {
-  if (!memcmp(config.bt_speed_sensor_id, mac, 6)) {
-    return true;
+void mac_set_build(void) {
+  memset(mac_set, 0, sizeof(mac_set));
+
+  const config_data *cfg = config_get();
+  mac_set_insert(cfg->bt_speed_sensor_id, MAC_SET_USED | MAC_SET_CONFIG);
+  mac_set_insert(cfg->bt_power_sensor_id, MAC_SET_USED | MAC_SET_CONFIG);
+
+  for (int i = 0; memcmp(bluetooth_mac_whitelist[i], mac_zero, 6); i++) {
+    mac_set_insert(bluetooth_mac_whitelist[i], MAC_SET_USED);
   }
-  if (!memcmp(config.bt_power_sensor_id, mac, 6)) {
-    return true;
+}
+
+bool mac_set_is_connected(const mac_set_entry *e) {
+  for (uint16_t conn_hdl = 0; conn_hdl < BLE_MAX_CONNECTION; conn_hdl++) {
+    BLEConnection* connection = Bluefruit.Connection(conn_hdl);
+    if (connection && connection->connected()) {
+      ble_gap_addr_t peer = connection->getPeerAddr();
+      if (!memcmp(peer.addr, e->addr.addr, 6)) {
+        return true;
+      }
+    }
   }
 
   return false;
 }
 
+int mac_set_missing(void) {
+  // Count the configured sensors which are not connected
+  int missing = 0;
+  for (int i = 0; i < MAC_SET_SIZE; i++) {
+    if ((mac_set[i].flags & MAC_SET_CONFIG)
+        && !mac_set_is_connected(&mac_set[i])) {
+      missing++;
+    }
+  }
+
+  return missing;
+}
+
 void scan_callback(ble_gap_evt_adv_report_t* report) {
-  if (check_mac_config(report->peer_addr.addr)) {
+  mac_set_entry *e = mac_set_lookup(report->peer_addr.addr);
+  if (e) {
     DEBUG_PRINT("Connecting to device with MAC %02X:%02X:%02X:%02X:%02X:%02X"
       " Signal = %d dBm\n",
       report->peer_addr.addr[5], report->peer_addr.addr[4],
       report->peer_addr.addr[3], report->peer_addr.addr[2],
       report->peer_addr.addr[1], report->peer_addr.addr[0],
       report->rssi);
-    Bluefruit.Central.connect(report);
+
+    // Remember the address type for direct connection next time
+    e->addr.addr_type = report->peer_addr.addr_type;
+    e->flags |= MAC_SET_SEEN;
+
+    if (Bluefruit.Central.connect(report)) {
+      return;
+    }
+  } else if (config_get()->follower_enable) {
+    uint8_t msd[BROADCAST_LEN];
+    int len = Bluefruit.Scanner.parseReportByType(report,
+      BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA, msd, sizeof(msd));
+    if (len) {
+      broadcast_receive(report->peer_addr.addr, msd, len);
+    }
   }
 
   Bluefruit.Scanner.resume();
 }
 
+void scan_set_state(int state) {
+  if (state == scan_state) {
+    return;
+  }
+
+  if (scan_state == SCAN_STATE_DIRECT) {
+    sd_ble_gap_connect_cancel();
+  }
+
+  Bluefruit.Scanner.stop();
+
+  switch (state) {
+    case SCAN_STATE_FAST:
+      Bluefruit.Scanner.setInterval(SCAN_FAST_INTERVAL, SCAN_FAST_WINDOW);
+      Bluefruit.Scanner.start(0);
+      break;
+    case SCAN_STATE_SLOW:
+      Bluefruit.Scanner.setInterval(SCAN_SLOW_INTERVAL, SCAN_SLOW_WINDOW);
+      Bluefruit.Scanner.start(0);
+      break;
+    case SCAN_STATE_FOLLOW:
+      Bluefruit.Scanner.setInterval(SCAN_FOLLOW_INTERVAL, SCAN_FOLLOW_WINDOW);
+      Bluefruit.Scanner.start(0);
+      break;
+    case SCAN_STATE_DIRECT:
+      // The connection is initiated by the caller
+      Bluefruit.Scanner.setInterval(SCAN_FAST_INTERVAL, SCAN_FAST_WINDOW);
+      break;
+    default:
+      break;
+  }
+
+  DEBUG_PRINT("Scan state %d -> %d\n", scan_state, state);
+  scan_state = state;
+  scan_state_millis = millis();
+}
+
+bool scan_direct_connect(void) {
+  // Try each configured (and missing) sensor in turn
+  for (int n = 0; n < MAC_SET_SIZE; n++) {
+    int i = (direct_connect_next + n) & (MAC_SET_SIZE - 1);
+    mac_set_entry *e = &mac_set[i];
+    if ((e->flags & MAC_SET_CONFIG) && !mac_set_is_connected(e)) {
+      direct_connect_next = (i + 1) & (MAC_SET_SIZE - 1);
+      scan_set_state(SCAN_STATE_DIRECT);
+      DEBUG_PRINT("Direct connect to %02X:%02X:%02X:%02X:%02X:%02X\n",
+        e->addr.addr[5], e->addr.addr[4], e->addr.addr[3],
+        e->addr.addr[2], e->addr.addr[1], e->addr.addr[0]);
+      if (Bluefruit.Central.connect(&e->addr)) {
+        return true;
+      }
+      scan_set_state(SCAN_STATE_IDLE);
+      return false;
+    }
+  }
+
+  return false;
+}
+
+void conn_request_params(uint16_t conn_handle, int state) {
+  if (conn_handle >= BT_MAX_LINKS) {
+    return;
+  }
+
+  BLEConnection* connection = Bluefruit.Connection(conn_handle);
+  if (!connection || !connection->connected()) {
+    return;
+  }
+
+  const config_data *cfg = config_get();
+  uint16_t interval;
+  uint16_t latency;
+  switch (state) {
+    case CONN_STATE_ACTIVE:
+      interval = cfg->bt_conn_active_interval;
+      latency = 0;
+      break;
+    case CONN_STATE_IDLE:
+      interval = cfg->bt_conn_idle_interval;
+      latency = cfg->bt_conn_idle_latency;
+      break;
+    case CONN_STATE_UART:
+      interval = cfg->bt_uart_interval;
+      latency = cfg->bt_uart_latency;
+      break;
+    default:
+      return;
+  }
+
+  DEBUG_PRINT("Requesting conn params for %d : interval = %d latency = %d\n",
+              conn_handle, interval, latency);
+
+  if (connection->requestConnectionParameter(
+      CONN_MS_TO_INTERVAL(interval), latency,
+      CONN_MS_TO_TIMEOUT(cfg->bt_conn_timeout))) {
+    conn_links[conn_handle].state = state;
+    conn_links[conn_handle].millis = millis();
+  }
+}
+
+void conn_policy_loop(void) {
+  // Select the active or idle parameters for each sensor link
+  unsigned long now = millis();
+  if ((now - conn_policy_millis) < CONN_POLICY_PERIOD) {
+    return;
+  }
+  conn_policy_millis = now;
+
+  for (uint16_t conn_handle = 0; conn_handle < BT_MAX_LINKS; conn_handle++) {
+    conn_link *link = &conn_links[conn_handle];
+    if (link->role != CONN_ROLE_SENSOR) {
+      continue;
+    }
+
+    unsigned long activity = 0;
+    if (clientSandC.discovered() && clientSandC.connHandle() == conn_handle) {
+      activity = clientSandC.getSandC()->getLastActivity();
+    }
+    if (clientPower.discovered() && clientPower.connHandle() == conn_handle) {
+      unsigned long power = clientPower.getPower()->getLastActivity();
+      if (!activity || (static_cast<long>(power - activity) > 0)) {
+        activity = power;
+      }
+    }
+
+    bool active = activity
+      && ((now - activity) < static_cast<unsigned long>(
+          config_get()->bt_conn_idle_timeout));
+    if (active && (link->state != CONN_STATE_ACTIVE)) {
+      conn_request_params(conn_handle, CONN_STATE_ACTIVE);
+    } else if (!active && (link->state != CONN_STATE_IDLE)) {
+      conn_request_params(conn_handle, CONN_STATE_IDLE);
+    }
+  }
+}
+
+void ble_event_callback(ble_evt_t* evt) {
+  if (evt->header.evt_id == BLE_GAP_EVT_CONN_PARAM_UPDATE) {
+    ble_gap_conn_params_t* params =
+      &evt->evt.gap_evt.params.conn_param_update.conn_params;
+    (void) params;
+
+    // Interval in units of 1.25 ms, timeout in units of 10 ms
+    DEBUG_PRINT("Conn params granted for %d : interval = %d.%02d ms"
+                " latency = %d timeout = %d ms\n",
+                evt->evt.gap_evt.conn_handle,
+                params->max_conn_interval * 5 / 4,
+                (params->max_conn_interval * 125) % 100,
+                params->slave_latency,
+                params->conn_sup_timeout * 10);
+  }
+}
+
 void connect_callback(uint16_t conn_handle) {
   BLEConnection* connection = Bluefruit.Connection(conn_handle);
 
@@ -89,6 +360,11 @@ void connect_callback(uint16_t conn_handle) {
   connection->getPeerName(peer_name, sizeof(peer_name));
   DEBUG_PRINT("Connected to : %s\n", peer_name);
 
+  // The scanner (or direct connect) has stopped, let the
+  // scheduler decide what to do next
+  scan_state = SCAN_STATE_IDLE;
+  scan_reschedule = true;
+
   bool notify = false;
   if (clientSandC.discover(conn_handle)) {
     if ( !clientSandC.enableNotify() ) {
@@ -111,13 +387,25 @@ void connect_callback(uint16_t conn_handle) {
   if (!notify) {
       DEBUG_COMMENT("Error: Disconnecting\n");
       Bluefruit.disconnect(conn_handle);
+      return;
+  }
+
+  // Start on the active parameters, the policy will relax them
+  // once the sensor stops reporting activity.
+  if (conn_handle < BT_MAX_LINKS) {
+    conn_links[conn_handle].role = CONN_ROLE_SENSOR;
+    conn_links[conn_handle].state = CONN_STATE_NONE;
   }
+  conn_request_params(conn_handle, CONN_STATE_ACTIVE);
 }
 
 void disconnect_callback(uint16_t conn_handle, uint8_t reason) {
-  (void) conn_handle;
-
   DEBUG_PRINT("Disconnected, reason = 0x%02X\n", reason);
+  if (conn_handle < BT_MAX_LINKS) {
+    conn_links[conn_handle].role = CONN_ROLE_NONE;
+    conn_links[conn_handle].state = CONN_STATE_NONE;
+  }
+  scan_reschedule = true;
 }
 
 void uart_connect_callback(uint16_t conn_handle) {
@@ -126,37 +414,244 @@ void uart_connect_callback(uint16_t conn_handle) {
   char peer_name[NAME_BUFFER_LEN] = { 0 };
   connection->getPeerName(peer_name, sizeof(peer_name));
   DEBUG_PRINT("Device connected to UART : %s\n", peer_name);
+
+  if (conn_handle < BT_MAX_LINKS) {
+    conn_links[conn_handle].role = CONN_ROLE_UART;
+    conn_links[conn_handle].state = CONN_STATE_NONE;
+  }
+  conn_request_params(conn_handle, CONN_STATE_UART);
+  connection->requestMtuExchange(BT_UART_MTU);
+  uart_conn_handle = conn_handle;
+
+  // Keep broadcasting (non-connectable) while the UART is in use
+  broadcast_refresh();
 }
 
 void uart_disconnect_callback(uint16_t conn_handle, uint8_t reason) {
   (void) reason;
-  (void) conn_handle;
+
+  // Advertising restarts on its own as it was, which is non-connectable
+  // unless broadcast_loop() sets it up again
+  uart_conn_handle = BLE_CONN_HANDLE_INVALID;
+  if (config_get()->broadcast_enable) {
+    broadcast_refresh();
+  } else {
+    bluetooth_advertising_start(NULL, 0);
+  }
+  if (conn_handle < BT_MAX_LINKS) {
+    conn_links[conn_handle].role = CONN_ROLE_NONE;
+    conn_links[conn_handle].state = CONN_STATE_NONE;
+  }
 
   DEBUG_COMMENT("Device disconnected from UART.\n");
 }
 
 void uart_rx_callback(uint16_t conn_handle) {
-  (void) conn_handle;
+  // Let the user read the data, no need to copy it here
+  (*uart_usr_rx_callback)(conn_handle, uart_usr_rx_callback_ptr);
+}
+
+int bluetooth_uart_read(uint8_t *buf, int len) {
+  return bleuart.read(buf, len);
+}
+
+int bluetooth_uart_write(const uint8_t *buf, int len) {
+  return bleuart.write(buf, len);
+}
 
-  // Forward data from Mobile to our peripheral
-  char str[UART_STR_BUFFER_LEN] = { 0 };
-  bleuart.read(str, sizeof(str));
+bool bluetooth_uart_connected(void) {
+  return (uart_conn_handle != BLE_CONN_HANDLE_INVALID)
+    && bleuart.notifyEnabled(uart_conn_handle);
+}
 
-  DEBUG_PRINT("Recieved : %s\n", str);
+int bluetooth_uart_mtu(void) {
+  // Usable payload of one notification
+  BLEConnection* connection = Bluefruit.Connection(uart_conn_handle);
+  if (!connection) {
+    return BLE_GATT_ATT_MTU_DEFAULT - 3;
+  }
 
-  // Now do callback
-  (*uart_usr_rx_callback)(str, sizeof(str), uart_usr_rx_callback_ptr);
+  return connection->getMtu() - 3;
 }
 
 float bluetooth_calculate_speed(void) {
   return clientSandC.getSandC()->calculate();
 }
 
+float bluetooth_calculate_cadence(void) {
+  if (!clientSandC.discovered()) {
+    return 0.0;
+  }
+
+  return clientSandC.getSandC()->calculateCadence();
+}
+
+bool bluetooth_speed_valid(void) {
+  // True if the speed sensor has sent data recently
+  if (!clientSandC.discovered()) {
+    return false;
+  }
+
+  unsigned long last = clientSandC.getSandC()->getLastUpdate();
+  return last && ((millis() - last) < SENSOR_TIMEOUT);
+}
+
+unsigned long bluetooth_speed_stamp(void) {
+  // Arrival time (micros) of the last speed sample
+  return clientSandC.getSandC()->getLastUpdateMicros();
+}
+
+int bluetooth_get_power(void) {
+  if (!clientPower.discovered()) {
+    return 0;
+  }
+
+  return clientPower.getPower()->getInstPower();
+}
+
 void bluetooth_set_rx_callback(bluetoothFuncPtr_t func, void* ctx) {
   uart_usr_rx_callback = func;
   uart_usr_rx_callback_ptr = ctx;
 }
 
+void scan_set_filters(void) {
+  // Followers need to see the advertisements of other controllers
+  Bluefruit.Scanner.clearFilters();
+  if (!config_get()->follower_enable) {
+    Bluefruit.Scanner.filterUuid(clientSandC.uuid, clientPower.uuid);
+  }
+}
+
+void bluetooth_advertising_start(const uint8_t *msd, int msd_len) {
+  Bluefruit.Advertising.stop();
+  Bluefruit.Advertising.clearData();
+  Bluefruit.ScanResponse.clearData();
+
+  Bluefruit.Advertising.addFlags(BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE);
+  if (msd_len) {
+    // Broadcast data takes the place of the UART service, which is
+    // moved to the scan response to make space.
+    Bluefruit.Advertising.addData(BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA,
+      msd, msd_len);
+    Bluefruit.Advertising.addName();
+    Bluefruit.ScanResponse.addService(bleuart);
+    Bluefruit.ScanResponse.addTxPower();
+    Bluefruit.Advertising.setInterval(BROADCAST_INTERVAL, BROADCAST_INTERVAL);
+  } else {
+    Bluefruit.Advertising.addTxPower();
+    Bluefruit.Advertising.addService(bleuart);
+    Bluefruit.ScanResponse.addName();
+    Bluefruit.Advertising.setInterval(32, 244);    // in unit of 0.625 ms
+  }
+
+  // Only one peripheral link, so when the UART is connected we can
+  // only carry on as a broadcaster
+  if (uart_conn_handle != BLE_CONN_HANDLE_INVALID) {
+    Bluefruit.Advertising.setType(
+      BLE_GAP_ADV_TYPE_NONCONNECTABLE_SCANNABLE_UNDIRECTED);
+  } else {
+    Bluefruit.Advertising.setType(
+      BLE_GAP_ADV_TYPE_CONNECTABLE_SCANNABLE_UNDIRECTED);
+  }
+
+  Bluefruit.Advertising.start(0);  // 0 = Don't stop advertising after n seconds
+}
+
+void bluetooth_update_config(void) {
+  // Rebuild the MAC set and restart the scan scheduler
+  mac_set_build();
+  scan_set_state(SCAN_STATE_IDLE);
+  scan_set_filters();
+  scan_reschedule = true;
+
+  if (config_get()->broadcast_enable) {
+    broadcast_refresh();
+  } else if (uart_conn_handle == BLE_CONN_HANDLE_INVALID) {
+    bluetooth_advertising_start(NULL, 0);
+  } else {
+    // Config changes come over the UART, and while it is connected we
+    // could only advertise as a broadcaster. uart_disconnect_callback()
+    // starts connectable advertising again.
+    Bluefruit.Advertising.stop();
+  }
+}
+
+void bluetooth_loop(void) {
+  conn_policy_loop();
+
+  unsigned long now = millis();
+  if (!scan_reschedule
+      && ((now - scan_schedule_millis) < SCAN_SCHEDULE_PERIOD)) {
+    return;
+  }
+  scan_reschedule = false;
+  scan_schedule_millis = now;
+
+  bool configured = false;
+  for (int i = 0; i < MAC_SET_SIZE; i++) {
+    if (mac_set[i].flags & MAC_SET_CONFIG) {
+      configured = true;
+    }
+  }
+
+  if (!configured) {
+    // Nothing configured, just look for whitelisted devices at low duty
+    if (config_get()->follower_enable) {
+      scan_set_state(SCAN_STATE_FOLLOW);
+    } else {
+      scan_set_state(SCAN_STATE_SLOW);
+    }
+    return;
+  }
+
+  if (!mac_set_missing()) {
+    // Everything we want is connected, stop scanning unless following
+    if (config_get()->follower_enable) {
+      scan_set_state(SCAN_STATE_FOLLOW);
+    } else {
+      scan_set_state(SCAN_STATE_IDLE);
+    }
+    return;
+  }
+
+  if (config_get()->follower_enable) {
+    // Direct connect would stop us hearing the leader
+    scan_set_state(SCAN_STATE_FAST);
+    return;
+  }
+
+  unsigned long elapsed = now - scan_state_millis;
+  switch (scan_state) {
+    case SCAN_STATE_DIRECT:
+      if (elapsed > DIRECT_CONNECT_TIMEOUT) {
+        // Peer not found at its known address, fall back to scanning
+        scan_set_state(SCAN_STATE_FAST);
+      }
+      break;
+    case SCAN_STATE_FAST:
+      // Fast scan found nothing, try the known addresses and otherwise
+      // drop to a low duty scan so the next attempt is not every tick
+      if (elapsed > SCAN_FAST_PERIOD) {
+        if (!scan_direct_connect()) {
+          scan_set_state(SCAN_STATE_SLOW);
+        }
+      }
+      break;
+    case SCAN_STATE_SLOW:
+      if (elapsed > SCAN_SLOW_PERIOD) {
+        if (!scan_direct_connect()) {
+          scan_set_state(SCAN_STATE_FAST);
+        }
+      }
+      break;
+    default:
+      if (!scan_direct_connect()) {
+        scan_set_state(SCAN_STATE_FAST);
+      }
+      break;
+  }
+}
+
 int bluetooth_get_connections(void) {
   int rtn = 0;
   if (clientSandC.discovered()) {
@@ -171,10 +666,22 @@ int bluetooth_get_connections(void) {
 }
 
 void bluetooth_setup(void) {
+  // Allow a large MTU on the UART link so telemetry can be packed
+  Bluefruit.configPrphBandwidth(BANDWIDTH_MAX);
   Bluefruit.begin(1, 2);
   Bluefruit.setTxPower(4);
   Bluefruit.setName(BT_NAME);
 
+  // Initial connection parameters, changed per link by the policy
+  const config_data *cfg = config_get();
+  Bluefruit.Periph.setConnInterval(
+    CONN_MS_TO_INTERVAL(cfg->bt_uart_interval),
+    CONN_MS_TO_INTERVAL(cfg->bt_uart_interval));
+  Bluefruit.Central.setConnInterval(
+    CONN_MS_TO_INTERVAL(cfg->bt_conn_active_interval),
+    CONN_MS_TO_INTERVAL(cfg->bt_conn_active_interval));
+  Bluefruit.setEventCallback(ble_event_callback);
+
   // Set Connect / Disconnect Callbacks
   Bluefruit.Periph.setConnectCallback(uart_connect_callback);
   Bluefruit.Periph.setDisconnectCallback(uart_disconnect_callback);
@@ -188,21 +695,22 @@ void bluetooth_setup(void) {
   bleuart.begin();
   bleuart.setRxCallback(uart_rx_callback);
 
+  // Scanning is started by the scheduler in bluetooth_loop()
+  mac_set_build();
   Bluefruit.Scanner.setRxCallback(scan_callback);
-  Bluefruit.Scanner.restartOnDisconnect(true);
-  Bluefruit.Scanner.filterUuid(clientSandC.uuid, clientPower.uuid);
-  Bluefruit.Scanner.setInterval(160, 80);  // in unit of 0.625 ms
+  Bluefruit.Scanner.restartOnDisconnect(false);
+  scan_set_filters();
+  Bluefruit.Scanner.setInterval(SCAN_FAST_INTERVAL, SCAN_FAST_WINDOW);
   Bluefruit.Scanner.useActiveScan(false);
-  Bluefruit.Scanner.start(0);
 
-  Bluefruit.Advertising.addFlags(BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE);
-  Bluefruit.Advertising.addTxPower();
-  Bluefruit.Advertising.addService(bleuart);
-  Bluefruit.ScanResponse.addName();
   Bluefruit.Advertising.restartOnDisconnect(true);
-  Bluefruit.Advertising.setInterval(32, 244);    // in unit of 0.625 ms
   Bluefruit.Advertising.setFastTimeout(30);  // number of seconds in fast mode
-  Bluefruit.Advertising.start(0);  // 0 = Don't stop advertising after n seconds
+  if (config_get()->broadcast_enable) {
+    // Started by broadcast_loop() with the broadcast data
+    broadcast_refresh();
+  } else {
+    bluetooth_advertising_start(NULL, 0);
+  }
 
   Bluefruit.setConnLedInterval(250);
 }
@@ -26,15 +26,63 @@
 #define SRC_BLUETOOTH_H_
 
 #define BT_NAME                 "FAN CONTROLLER"
-#define UART_STR_BUFFER_LEN     2048
 #define NAME_BUFFER_LEN         64
 
-typedef void (*bluetoothFuncPtr_t)(const char* cmd,
-    const int cmd_len, void* ctx);
+// Hashed set of MAC addresses to connect to (must be a power of 2)
+#define MAC_SET_BITS            3
+#define MAC_SET_SIZE            (1 << MAC_SET_BITS)
+#define MAC_SET_USED            0x01
+#define MAC_SET_CONFIG          0x02
+#define MAC_SET_SEEN            0x04
+
+// Scan scheduler, intervals and windows in units of 0.625 ms
+#define SCAN_STATE_IDLE         0
+#define SCAN_STATE_FAST         1
+#define SCAN_STATE_SLOW         2
+#define SCAN_STATE_DIRECT       3
+#define SCAN_STATE_FOLLOW       4
+#define SCAN_FAST_INTERVAL      96
+#define SCAN_FAST_WINDOW        48
+#define SCAN_SLOW_INTERVAL      1600
+#define SCAN_SLOW_WINDOW        48
+#define SCAN_FOLLOW_INTERVAL    160
+#define SCAN_FOLLOW_WINDOW      80
+#define SCAN_SCHEDULE_PERIOD    500
+#define SCAN_FAST_PERIOD        10000
+#define SCAN_SLOW_PERIOD        30000
+#define DIRECT_CONNECT_TIMEOUT  5000
+
+// Connection parameter policy
+#define BT_MAX_LINKS            3
+#define CONN_ROLE_NONE          0
+#define CONN_ROLE_SENSOR        1
+#define CONN_ROLE_UART          2
+#define CONN_STATE_NONE         0
+#define CONN_STATE_ACTIVE       1
+#define CONN_STATE_IDLE         2
+#define CONN_STATE_UART         3
+#define CONN_POLICY_PERIOD      1000
+#define CONN_MS_TO_INTERVAL(x)  ((x) * 4 / 5)   // units of 1.25 ms
+#define CONN_MS_TO_TIMEOUT(x)   ((x) / 10)      // units of 10 ms
+#define BT_UART_MTU             247
+#define SENSOR_TIMEOUT          5000  // ms without data before invalid
+
+typedef void (*bluetoothFuncPtr_t)(uint16_t conn_handle, void* ctx);
 
 void bluetooth_setup(void);
+void bluetooth_loop(void);
+void bluetooth_update_config(void);
+void bluetooth_advertising_start(const uint8_t *msd, int msd_len);
 void bluetooth_set_rx_callback(bluetoothFuncPtr_t func, void* ctx);
+int bluetooth_uart_read(uint8_t *buf, int len);
+int bluetooth_uart_write(const uint8_t *buf, int len);
+bool bluetooth_uart_connected(void);
+int bluetooth_uart_mtu(void);
 float bluetooth_calculate_speed(void);
+float bluetooth_calculate_cadence(void);
+bool bluetooth_speed_valid(void);
+unsigned long bluetooth_speed_stamp(void);
+int bluetooth_get_power(void);
 int bluetooth_get_connections(void);
 
 #endif  // SRC_BLUETOOTH_H_
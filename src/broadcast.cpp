@@ -0,0 +1,201 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "hal.h"
+#include "debug.h"
+#include "config.h"
+#include "bluetooth.h"
+#include "control.h"
+#include "sensor.h"
+#include "broadcast.h"
+
+// Our state (leader)
+
+uint8_t broadcast_payload[BROADCAST_LEN];
+uint8_t broadcast_seq = 0;
+unsigned long broadcast_millis = 0;
+volatile bool broadcast_needs_refresh = true;
+
+// Last state received from a leader (follower). Written from the
+// scan callback in the BLE task and read from loop(), so it is published
+// under a sequence count which is odd while a write is in progress. A
+// reader copies it out and tries again if the count was odd or moved.
+// The BLE task runs above loop(), so a writer never waits on a reader.
+
+typedef struct {
+  broadcast_data data;
+  unsigned long millis;
+  unsigned long micros;
+} broadcast_leader_state;
+
+uint32_t broadcast_leader_seq = 0;
+broadcast_leader_state broadcast_leader = {{0, 0, 0, {0, 0}}, 0, 0};
+
+static void broadcast_leader_write(const broadcast_leader_state *state) {
+  uint32_t seq = __atomic_load_n(&broadcast_leader_seq, __ATOMIC_RELAXED);
+  __atomic_store_n(&broadcast_leader_seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  broadcast_leader = *state;
+  __atomic_store_n(&broadcast_leader_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void broadcast_leader_read(broadcast_leader_state *state) {
+  uint32_t seq;
+  do {
+    seq = __atomic_load_n(&broadcast_leader_seq, __ATOMIC_ACQUIRE);
+    *state = broadcast_leader;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((seq & 1)
+    || (seq != __atomic_load_n(&broadcast_leader_seq, __ATOMIC_RELAXED)));
+}
+
+int broadcast_encode(uint8_t *buf, const broadcast_data *data) {
+  uint16_t speed = 0;
+  if (data->speed >= 655.35) {
+    speed = 65535;
+  } else if (data->speed > 0) {
+    speed = static_cast<uint16_t>(data->speed * 100);
+  }
+
+  buf[0] = BROADCAST_COMPANY_ID & 0xFF;
+  buf[1] = BROADCAST_COMPANY_ID >> 8;
+  buf[2] = BROADCAST_MAGIC;
+  buf[3] = BROADCAST_VERSION;
+  buf[4] = data->seq;
+  buf[5] = speed & 0xFF;
+  buf[6] = speed >> 8;
+  buf[7] = data->power & 0xFF;
+  buf[8] = (data->power >> 8) & 0xFF;
+  buf[9] = data->op[0];
+  buf[10] = data->op[1];
+
+  return BROADCAST_LEN;
+}
+
+int broadcast_decode(const uint8_t *buf, int len, broadcast_data *data) {
+  if (len < BROADCAST_LEN) {
+    return -1;
+  }
+
+  if ((buf[0] != (BROADCAST_COMPANY_ID & 0xFF))
+      || (buf[1] != (BROADCAST_COMPANY_ID >> 8))
+      || (buf[2] != BROADCAST_MAGIC)
+      || (buf[3] != BROADCAST_VERSION)) {
+    return -1;
+  }
+
+  data->seq = buf[4];
+  data->speed = static_cast<float>(buf[5] | (buf[6] << 8)) / 100;
+  data->power = static_cast<int16_t>(buf[7] | (buf[8] << 8));
+  data->op[0] = buf[9];
+  data->op[1] = buf[10];
+
+  return 0;
+}
+
+void broadcast_receive(const uint8_t *mac, const uint8_t *buf, int len) {
+  // Called from the scan callback for every advertisement with
+  // manufacturer data when we are a follower
+  static const uint8_t zero[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+  const uint8_t *leader = config_get()->follower_leader_id;
+  if (memcmp(leader, zero, 6) && memcmp(leader, mac, 6)) {
+    return;
+  }
+
+  broadcast_leader_state state;
+  if (broadcast_decode(buf, len, &state.data)) {
+    return;
+  }
+
+  state.millis = hal_millis();
+  state.micros = hal_micros();
+  broadcast_leader_write(&state);
+}
+
+bool broadcast_leader_valid(void) {
+  if (!config_get()->follower_enable) {
+    return false;
+  }
+
+  broadcast_leader_state state;
+  broadcast_leader_read(&state);
+  return state.millis && ((hal_millis() - state.millis) < SENSOR_TIMEOUT);
+}
+
+float broadcast_leader_speed(void) {
+  broadcast_leader_state state;
+  broadcast_leader_read(&state);
+  return state.data.speed;
+}
+
+unsigned long broadcast_leader_stamp(void) {
+  broadcast_leader_state state;
+  broadcast_leader_read(&state);
+  return state.micros;
+}
+
+int broadcast_leader_power(void) {
+  broadcast_leader_state state;
+  broadcast_leader_read(&state);
+  return state.data.power;
+}
+
+void broadcast_refresh(void) {
+  // Advertising must be set up again, e.g. after a UART disconnect
+  broadcast_needs_refresh = true;
+}
+
+void broadcast_loop(void) {
+  if (!config_get()->broadcast_enable) {
+    return;
+  }
+
+  unsigned long now = hal_millis();
+  if ((now - broadcast_millis) < BROADCAST_PERIOD) {
+    return;
+  }
+  broadcast_millis = now;
+
+  broadcast_data data;
+  data.seq = broadcast_seq;
+  data.speed = control_get_speed();
+  data.power = sensor_get_power();
+  data.op[0] = control_get_output(0);
+  data.op[1] = control_get_output(1);
+
+  uint8_t payload[BROADCAST_LEN];
+  broadcast_encode(payload, &data);
+  if (!broadcast_needs_refresh
+      && !memcmp(&payload[5], &broadcast_payload[5], BROADCAST_LEN - 5)) {
+    // Nothing changed, leave the advertising alone
+    return;
+  }
+
+  // The seq lets followers see that the state changed
+  payload[4] = ++broadcast_seq;
+  memcpy(broadcast_payload, payload, BROADCAST_LEN);
+
+  broadcast_needs_refresh = false;
+  bluetooth_advertising_start(broadcast_payload, BROADCAST_LEN);
+}
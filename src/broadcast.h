@@ -0,0 +1,61 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_BROADCAST_H_
+#define SRC_BROADCAST_H_
+
+#include <stdint.h>
+
+// Fan state is broadcast as manufacturer specific data in the
+// advertising packet so other units and displays can follow it
+// without connecting. All values are little endian.
+//
+//   | u16 company | u8 magic | u8 version | u8 seq | u16 speed (0.01 mph) |
+//   | i16 power (W) | u8 op1 | u8 op2 |
+
+#define BROADCAST_COMPANY_ID    0xFFFF  // Reserved for testing
+#define BROADCAST_MAGIC         0xFA
+#define BROADCAST_VERSION       1
+#define BROADCAST_LEN           11
+#define BROADCAST_PERIOD        1000    // ms between updates
+#define BROADCAST_INTERVAL      160     // in units of 0.625 ms
+
+typedef struct {
+  uint8_t seq;
+  float speed;
+  int power;
+  uint8_t op[2];
+} broadcast_data;
+
+void broadcast_loop(void);
+void broadcast_refresh(void);
+int broadcast_encode(uint8_t *buf, const broadcast_data *data);
+int broadcast_decode(const uint8_t *buf, int len, broadcast_data *data);
+void broadcast_receive(const uint8_t *mac, const uint8_t *buf, int len);
+bool broadcast_leader_valid(void);
+float broadcast_leader_speed(void);
+int broadcast_leader_power(void);
+unsigned long broadcast_leader_stamp(void);
+
+#endif  // SRC_BROADCAST_H_
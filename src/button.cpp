@@ -0,0 +1,53 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <Arduino.h>
+#include "wiring.h"
+#include "button.h"
+
+int button_state = HIGH;
+int button_last = HIGH;
+unsigned long button_millis = 0;
+
+void button_setup(void) {
+  pinMode(PIN_PROFILE_BUTTON, INPUT_PULLUP);
+}
+
+bool button_pressed(void) {
+  // Polled from loop(), true once for each debounced press
+  int level = digitalRead(PIN_PROFILE_BUTTON);
+  if (level != button_last) {
+    button_last = level;
+    button_millis = millis();
+    return false;
+  }
+
+  if ((level == button_state)
+      || ((millis() - button_millis) < BUTTON_DEBOUNCE)) {
+    return false;
+  }
+
+  button_state = level;
+  return level == LOW;
+}
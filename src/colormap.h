@@ -1,258 +1,190 @@
-static uint32_t colormap[] = {
-  0x0a0000,
-  0x0d0000,
-  0x0f0000,
-  0x120000,
-  0x150000,
-  0x170000,
-  0x1a0000,
-  0x1c0000,
-  0x1f0000,
-  0x220000,
-  0x240000,
-  0x270000,
-  0x2a0000,
-  0x2c0000,
-  0x2f0000,
-  0x310000,
-  0x340000,
-  0x370000,
-  0x390000,
-  0x3c0000,
-  0x3f0000,
-  0x410000,
-  0x440000,
-  0x460000,
-  0x490000,
-  0x4c0000,
-  0x4e0000,
-  0x510000,
-  0x540000,
-  0x560000,
-  0x590000,
-  0x5b0000,
-  0x5e0000,
-  0x610000,
-  0x630000,
-  0x660000,
-  0x690000,
-  0x6b0000,
-  0x6e0000,
-  0x700000,
-  0x730000,
-  0x760000,
-  0x780000,
-  0x7b0000,
-  0x7e0000,
-  0x800000,
-  0x830000,
-  0x850000,
-  0x880000,
-  0x8b0000,
-  0x8d0000,
-  0x900000,
-  0x930000,
-  0x950000,
-  0x980000,
-  0x9a0000,
-  0x9d0000,
-  0xa00000,
-  0xa20000,
-  0xa50000,
-  0xa80000,
-  0xaa0000,
-  0xad0000,
-  0xaf0000,
-  0xb20000,
-  0xb50000,
-  0xb70000,
-  0xba0000,
-  0xbd0000,
-  0xbf0000,
-  0xc20000,
-  0xc40000,
-  0xc70000,
-  0xca0000,
-  0xcc0000,
-  0xcf0000,
-  0xd20000,
-  0xd40000,
-  0xd70000,
-  0xd90000,
-  0xdc0000,
-  0xdf0000,
-  0xe10000,
-  0xe40000,
-  0xe70000,
-  0xe90000,
-  0xec0000,
-  0xee0000,
-  0xf10000,
-  0xf40000,
-  0xf60000,
-  0xf90000,
-  0xfc0000,
-  0xfe0000,
-  0xff0200,
-  0xff0500,
-  0xff0700,
-  0xff0a00,
-  0xff0c00,
-  0xff0f00,
-  0xff1200,
-  0xff1400,
-  0xff1700,
-  0xff1a00,
-  0xff1c00,
-  0xff1f00,
-  0xff2100,
-  0xff2400,
-  0xff2700,
-  0xff2900,
-  0xff2c00,
-  0xff2f00,
-  0xff3100,
-  0xff3400,
-  0xff3600,
-  0xff3900,
-  0xff3c00,
-  0xff3e00,
-  0xff4100,
-  0xff4400,
-  0xff4600,
-  0xff4900,
-  0xff4b00,
-  0xff4e00,
-  0xff5100,
-  0xff5300,
-  0xff5600,
-  0xff5900,
-  0xff5b00,
-  0xff5e00,
-  0xff6000,
-  0xff6300,
-  0xff6600,
-  0xff6800,
-  0xff6b00,
-  0xff6e00,
-  0xff7000,
-  0xff7300,
-  0xff7500,
-  0xff7800,
-  0xff7b00,
-  0xff7d00,
-  0xff8000,
-  0xff8300,
-  0xff8500,
-  0xff8800,
-  0xff8a00,
-  0xff8d00,
-  0xff9000,
-  0xff9200,
-  0xff9500,
-  0xff9700,
-  0xff9a00,
-  0xff9d00,
-  0xff9f00,
-  0xffa200,
-  0xffa500,
-  0xffa700,
-  0xffaa00,
-  0xffac00,
-  0xffaf00,
-  0xffb200,
-  0xffb400,
-  0xffb700,
-  0xffba00,
-  0xffbc00,
-  0xffbf00,
-  0xffc100,
-  0xffc400,
-  0xffc700,
-  0xffc900,
-  0xffcc00,
-  0xffcf00,
-  0xffd100,
-  0xffd400,
-  0xffd600,
-  0xffd900,
-  0xffdc00,
-  0xffde00,
-  0xffe100,
-  0xffe400,
-  0xffe600,
-  0xffe900,
-  0xffeb00,
-  0xffee00,
-  0xfff100,
-  0xfff300,
-  0xfff600,
-  0xfff900,
-  0xfffb00,
-  0xfffe00,
-  0xffff02,
-  0xffff06,
-  0xffff0a,
-  0xffff0e,
-  0xffff12,
-  0xffff16,
-  0xffff1a,
-  0xffff1e,
-  0xffff22,
-  0xffff26,
-  0xffff2a,
-  0xffff2e,
-  0xffff32,
-  0xffff36,
-  0xffff3a,
-  0xffff3e,
-  0xffff41,
-  0xffff45,
-  0xffff49,
-  0xffff4d,
-  0xffff51,
-  0xffff55,
-  0xffff59,
-  0xffff5d,
-  0xffff61,
-  0xffff65,
-  0xffff69,
-  0xffff6d,
-  0xffff71,
-  0xffff75,
-  0xffff79,
-  0xffff7d,
-  0xffff80,
-  0xffff84,
-  0xffff88,
-  0xffff8c,
-  0xffff90,
-  0xffff94,
-  0xffff98,
-  0xffff9c,
-  0xffffa0,
-  0xffffa4,
-  0xffffa8,
-  0xffffac,
-  0xffffb0,
-  0xffffb4,
-  0xffffb8,
-  0xffffbc,
-  0xffffbf,
-  0xffffc3,
-  0xffffc7,
-  0xffffcb,
-  0xffffcf,
-  0xffffd3,
-  0xffffd7,
-  0xffffdb,
-  0xffffdf,
-  0xffffe3,
-  0xffffe7,
-  0xffffeb,
-  0xffffef,
-  0xfffff3,
-  0xfffff7,
-  0xfffffb,
-  0xffffff
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_COLORMAP_H_
+#define SRC_COLORMAP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Colormaps and gamma tables built by constexpr functions at compile
+// time, so the tables are constants in flash and take no RAM. A map is
+// a struct with a constexpr color(x) for x in 0 - 1, and is turned into
+// a 256 entry table (with gamma correction for the LEDs) by
+// colormap_table<Map>. Needs C++14 for the loops.
+
+#define COLORMAP_GAMMA          22    // Gamma x 10
+#define COLORMAP_HOT            0
+#define COLORMAP_VIRIDIS        1
+#define COLORMAP_CUSTOM         2
+
+struct cmap_rgb {
+  float r, g, b;
 };
+
+struct cmap_stop {
+  float x;
+  uint8_t r, g, b;
+};
+
+constexpr float cmap_clamp(float x) {
+  return (x < 0) ? 0 : ((x > 1) ? 1 : x);
+}
+
+constexpr float cmap_log(float x) {
+  // Natural log, x > 0. Reduce to [0.5, 1) then use the atanh series.
+  int e = 0;
+  while (x < 0.5f) {
+    x *= 2;
+    e--;
+  }
+  while (x >= 1.0f) {
+    x /= 2;
+    e++;
+  }
+
+  float z = (x - 1) / (x + 1);
+  float z2 = z * z;
+  float term = z;
+  float sum = 0;
+  for (int n = 1; n < 30; n += 2) {
+    sum += term / n;
+    term *= z2;
+  }
+
+  return 2 * sum + e * 0.69314718f;
+}
+
+constexpr float cmap_exp(float x) {
+  // Taylor series of x / 64, then squared six times
+  float r = x / 64;
+  float term = 1;
+  float sum = 1;
+  for (int n = 1; n < 12; n++) {
+    term *= r / n;
+    sum += term;
+  }
+  for (int n = 0; n < 6; n++) {
+    sum *= sum;
+  }
+
+  return sum;
+}
+
+constexpr float cmap_pow(float x, float y) {
+  return (x <= 0) ? 0 : cmap_exp(y * cmap_log(x));
+}
+
+constexpr uint8_t cmap_gamma(float x, int gamma10, int scale = 255) {
+  return static_cast<uint8_t>(
+    scale * cmap_pow(cmap_clamp(x), gamma10 / 10.0f) + 0.5f);
+}
+
+template <size_t N>
+constexpr cmap_rgb cmap_interp(const cmap_stop (&stops)[N], float x) {
+  // Linear interpolation between stops in increasing x
+  size_t i = 1;
+  while ((i < (N - 1)) && (x > stops[i].x)) {
+    i++;
+  }
+
+  float t = cmap_clamp((x - stops[i - 1].x) / (stops[i].x - stops[i - 1].x));
+  return {
+    (stops[i - 1].r + t * (stops[i].r - stops[i - 1].r)) / 255,
+    (stops[i - 1].g + t * (stops[i].g - stops[i - 1].g)) / 255,
+    (stops[i - 1].b + t * (stops[i].b - stops[i - 1].b)) / 255
+  };
+}
+
+struct colormap_hot {
+  // matplotlib "hot"
+  static constexpr cmap_rgb color(float x) {
+    return {
+      cmap_clamp(0.0416f + (x / 0.365079f) * (1 - 0.0416f)),
+      cmap_clamp((x - 0.365079f) / (0.746032f - 0.365079f)),
+      cmap_clamp((x - 0.746032f) / (1 - 0.746032f))
+    };
+  }
+};
+
+struct colormap_viridis {
+  // matplotlib "viridis" sampled at nine points
+  static constexpr cmap_rgb color(float x) {
+    constexpr cmap_stop stops[] = {
+      {0.000f,  68,   1,  84}, {0.125f,  71,  44, 122},
+      {0.250f,  59,  81, 139}, {0.375f,  44, 113, 142},
+      {0.500f,  33, 144, 141}, {0.625f,  39, 173, 129},
+      {0.750f,  92, 200,  99}, {0.875f, 170, 220,  50},
+      {1.000f, 253, 231,  37}
+    };
+    return cmap_interp(stops, x);
+  }
+};
+
+struct colormap_custom {
+  // Edit these stops for a custom map
+  static constexpr cmap_rgb color(float x) {
+    constexpr cmap_stop stops[] = {
+      {0.0f,   0,   0, 255}, {0.5f,   0, 255,   0},
+      {1.0f, 255,   0,   0}
+    };
+    return cmap_interp(stops, x);
+  }
+};
+
+template <class Map, int Gamma10 = COLORMAP_GAMMA>
+struct colormap_table {
+  uint32_t color[256];
+
+  constexpr colormap_table() : color() {
+    for (int i = 0; i < 256; i++) {
+      cmap_rgb c = Map::color(i / 255.0f);
+      color[i] = (static_cast<uint32_t>(cmap_gamma(c.r, Gamma10)) << 16)
+        | (static_cast<uint32_t>(cmap_gamma(c.g, Gamma10)) << 8)
+        | cmap_gamma(c.b, Gamma10);
+    }
+  }
+
+  constexpr uint32_t operator[](int i) const {
+    return color[i];
+  }
+};
+
+template <int Gamma10 = COLORMAP_GAMMA, int Brightness = 255>
+struct gamma_table {
+  // Maps a linear 0 - 255 value to an LED value scaled by brightness
+  uint8_t value[256];
+
+  constexpr gamma_table() : value() {
+    for (int i = 0; i < 256; i++) {
+      value[i] = cmap_gamma(i / 255.0f, Gamma10, Brightness);
+    }
+  }
+
+  constexpr uint8_t operator[](int i) const {
+    return value[i];
+  }
+};
+
+#endif  // SRC_COLORMAP_H_
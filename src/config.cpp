@@ -22,34 +22,264 @@
 // SOFTWARE.
 //
 
-#include <Arduino.h>
+#include "hal.h"
 #include "config.h"
 #include "debug.h"
+#include "sensor.h"
+#include "triac.h"
+#include "colormap.h"
+
+// The live config is published RCU style. Readers load the pointer
+// once and use that copy, config_publish_profiles() fills the other
+// bank and swaps the pointer. Publishing only happens from loop(), so
+// a reader in an interrupt or the BLE task is always done with a bank
+// before it is written again.
+//
+// Each bank holds every profile with its tables already built, so
+// selecting a profile is just a pointer swap.
+
+config_live config_banks[2][CONFIG_MAX_PROFILES];
+config_live* volatile config_active = &config_banks[0][0];
+uint32_t config_generation = 0;
+int config_bank = 0;
+int config_count = 1;
+int config_selected = 0;
+uint32_t config_dirty = 0;        // Runtime changes not from the file
+uint32_t config_selections = 0;
+
+static void config_build(config_live *live, const config_data *data) {
+  live->data = *data;
+  live->generation = ++config_generation;
+
+  for (int i = 0; i < CONFIG_OUTPUT_LEVELS; i++) {
+    live->triac_delay[i] = triac_calc_delay(data, i);
+  }
+}
+
+void config_publish_profiles(const config_data *profiles, int count,
+                             int select) {
+  if (count < 1) {
+    return;
+  }
+  if (count > CONFIG_MAX_PROFILES) {
+    count = CONFIG_MAX_PROFILES;
+  }
+  if ((select < 0) || (select >= count)) {
+    select = 0;
+  }
+
+  // Derived tables are rebuilt before the swap
+  int bank = config_bank ^ 1;
+  for (int i = 0; i < count; i++) {
+    config_build(&config_banks[bank][i], &profiles[i]);
+  }
+
+  config_bank = bank;
+  config_count = count;
+  config_selected = select;
+  __atomic_store_n(&config_active, &config_banks[bank][select],
+    __ATOMIC_RELEASE);
+}
+
+static void config_copy_profile(config_data *dst, const config_data *src) {
+  // Copy the settings a profile can override
+  memcpy(dst->name, src->name, CONFIG_NAME_LEN);
+  dst->speed_max = src->speed_max;
+  dst->speed_min = src->speed_min;
+  dst->speed_threshold = src->speed_threshold;
+  memcpy(dst->bt_speed_sensor_id, src->bt_speed_sensor_id, 6);
+  memcpy(dst->bt_power_sensor_id, src->bt_power_sensor_id, 6);
+  dst->virtual_priority = src->virtual_priority;
+}
+
+void config_publish(const config_data *data) {
+  // Replace the selected profile. Settings which are not part of a
+  // profile are shared, so they are changed in all of them.
+  config_data profiles[CONFIG_MAX_PROFILES];
+  for (int i = 0; i < config_count; i++) {
+    profiles[i] = *data;
+    if (i != config_selected) {
+      config_copy_profile(&profiles[i], &config_banks[config_bank][i].data);
+    }
+  }
+
+  config_publish_profiles(profiles, config_count, config_selected);
+  config_dirty++;
+}
+
+int config_profile_select(int index) {
+  if ((index < 0) || (index >= config_count)) {
+    return -1;
+  }
+
+  config_selected = index;
+  __atomic_store_n(&config_active, &config_banks[config_bank][index],
+    __ATOMIC_RELEASE);
+  config_dirty++;
+  config_selections++;
+
+  DEBUG_PRINT("Selected profile %d [%s]\n", index,
+    config_banks[config_bank][index].data.name);
+  return 0;
+}
+
+uint32_t config_dirty_generation(void) {
+  // Changes from config_publish() and config_profile_select() only, so
+  // that loading the file does not cause it to be written again
+  return config_dirty;
+}
+
+uint32_t config_select_generation(void) {
+  // Counts config_profile_select() calls. A publish is seen from the new
+  // generation of config_live instead, as two publishes or selects can
+  // land back on the same config_live.
+  return config_selections;
+}
+
+int config_profile_get(void) {
+  return config_selected;
+}
+
+int config_profile_count(void) {
+  return config_count;
+}
+
+const config_data* config_profile_data(int index) {
+  if ((index < 0) || (index >= config_count)) {
+    return NULL;
+  }
+
+  return &config_banks[config_bank][index].data;
+}
 
 void config_set_defaults(void) {
-  config.speed_max = 15.0;
-  config.speed_min = 5.0;
-  config.speed_threshold = 1.5;
-  config.triac_off_delay = 4000L;
-  config.triac_on_delay = 1L;
+  config_data data;
+  memset(&data, 0, sizeof(data));
+
+  snprintf(data.name, CONFIG_NAME_LEN, "default");
+
+  data.speed_max = 15.0;
+  data.speed_min = 5.0;
+  data.speed_threshold = 1.5;
+  data.triac_off_delay = 4000L;
+  data.triac_on_delay = 1L;
+  for (int i = 0; i < 6; i++) {
+    data.bt_speed_sensor_id[i] = 0;
+    data.bt_power_sensor_id[i] = 0;
+  }
+  data.bt_conn_active_interval = 15;
+  data.bt_conn_idle_interval = 100;
+  data.bt_conn_idle_latency = 4;
+  data.bt_conn_idle_timeout = 10000;
+  data.bt_conn_timeout = 4000;
+  data.bt_uart_interval = 30;
+  data.bt_uart_latency = 0;
+  data.virtual_priority = VIRTUAL_FALLBACK;
+  data.virtual_timeout = 2000;
+  data.broadcast_enable = true;
+  data.follower_enable = false;
   for (int i = 0; i < 6; i++) {
-    config.bt_speed_sensor_id[i] = 0;
-    config.bt_power_sensor_id[i] = 0;
+    data.follower_leader_id[i] = 0;
   }
+  data.latency_slo = 0;
+  data.ridelog_enable = false;
+  data.ridelog_period = 1000;
+  data.ridelog_size = 256;
+  data.ridelog_trace = false;
+  data.persist_delay = 10000;
+  data.indicator_colormap = COLORMAP_HOT;
+
+  config_publish_profiles(&data, 1, 0);
+}
+
+int config_validate(const config_data *data) {
+  // Returns zero if the config is usable
+  if ((data->speed_min < 0) || (data->speed_max <= data->speed_min)) {
+    DEBUG_COMMENT("Invalid speed range\n");
+    return -1;
+  }
+
+  if ((data->speed_threshold < 0)
+      || (data->speed_threshold > data->speed_max)) {
+    DEBUG_COMMENT("Invalid speed threshold\n");
+    return -2;
+  }
+
+  // Delays are within one half cycle of 50 Hz mains
+  if ((data->triac_off_delay == 0) || (data->triac_off_delay > 10000)
+      || (data->triac_on_delay >= data->triac_off_delay)) {
+    DEBUG_COMMENT("Invalid triac delays\n");
+    return -3;
+  }
+
+  // BLE allows connection intervals of 7.5 ms to 4 s
+  if ((data->bt_conn_active_interval < 8)
+      || (data->bt_conn_active_interval > 4000)
+      || (data->bt_conn_idle_interval < 8)
+      || (data->bt_conn_idle_interval > 4000)
+      || (data->bt_uart_interval < 8) || (data->bt_uart_interval > 4000)
+      || (data->bt_conn_timeout < 100) || (data->bt_conn_timeout > 32000)) {
+    DEBUG_COMMENT("Invalid bluetooth connection parameters\n");
+    return -4;
+  }
+
+  if (data->virtual_priority > VIRTUAL_ONLY) {
+    DEBUG_COMMENT("Invalid virtual priority\n");
+    return -5;
+  }
+
+  if ((data->ridelog_period < 100) || (data->ridelog_size < 4)) {
+    DEBUG_COMMENT("Invalid ride log settings\n");
+    return -6;
+  }
+
+  if (data->indicator_colormap > COLORMAP_CUSTOM) {
+    DEBUG_COMMENT("Invalid colormap\n");
+    return -7;
+  }
+
+  return 0;
 }
 
 void config_print(void) {
-  DEBUG_PRINT("speed_max              = %f\n", config.speed_max);
-  DEBUG_PRINT("speed_min              = %f\n", config.speed_min);
-  DEBUG_PRINT("speed_threshold        = %f\n", config.speed_threshold);
-  DEBUG_PRINT("triac_on_delay         = %ld\n", config.triac_on_delay);
-  DEBUG_PRINT("triac_off_delay        = %ld\n", config.triac_off_delay);
+  const config_data *cfg = config_get();
+  DEBUG_PRINT("profile                = %d of %d [%s]\n",
+    config_selected, config_count, cfg->name);
+  DEBUG_PRINT("speed_max              = %f\n", cfg->speed_max);
+  DEBUG_PRINT("speed_min              = %f\n", cfg->speed_min);
+  DEBUG_PRINT("speed_threshold        = %f\n", cfg->speed_threshold);
+  DEBUG_PRINT("triac_on_delay         = %ld\n", cfg->triac_on_delay);
+  DEBUG_PRINT("triac_off_delay        = %ld\n", cfg->triac_off_delay);
   DEBUG_PRINT("bt_speed_sensor_id     = %02X:%02X:%02X:%02X:%02X:%02X\n",
-              config.bt_speed_sensor_id[5], config.bt_speed_sensor_id[4],
-              config.bt_speed_sensor_id[3], config.bt_speed_sensor_id[2],
-              config.bt_speed_sensor_id[1], config.bt_speed_sensor_id[0]);
+              cfg->bt_speed_sensor_id[5], cfg->bt_speed_sensor_id[4],
+              cfg->bt_speed_sensor_id[3], cfg->bt_speed_sensor_id[2],
+              cfg->bt_speed_sensor_id[1], cfg->bt_speed_sensor_id[0]);
   DEBUG_PRINT("bt_power_sensor_id     = %02X:%02X:%02X:%02X:%02X:%02X\n",
-              config.bt_power_sensor_id[5], config.bt_power_sensor_id[4],
-              config.bt_power_sensor_id[3], config.bt_power_sensor_id[2],
-              config.bt_power_sensor_id[1], config.bt_power_sensor_id[0]);
+              cfg->bt_power_sensor_id[5], cfg->bt_power_sensor_id[4],
+              cfg->bt_power_sensor_id[3], cfg->bt_power_sensor_id[2],
+              cfg->bt_power_sensor_id[1], cfg->bt_power_sensor_id[0]);
+  DEBUG_PRINT("bt_conn_active_interval = %d\n",
+              cfg->bt_conn_active_interval);
+  DEBUG_PRINT("bt_conn_idle_interval  = %d\n", cfg->bt_conn_idle_interval);
+  DEBUG_PRINT("bt_conn_idle_latency   = %d\n", cfg->bt_conn_idle_latency);
+  DEBUG_PRINT("bt_conn_idle_timeout   = %d\n", cfg->bt_conn_idle_timeout);
+  DEBUG_PRINT("bt_conn_timeout        = %d\n", cfg->bt_conn_timeout);
+  DEBUG_PRINT("bt_uart_interval       = %d\n", cfg->bt_uart_interval);
+  DEBUG_PRINT("bt_uart_latency        = %d\n", cfg->bt_uart_latency);
+  DEBUG_PRINT("virtual_priority       = %d\n", cfg->virtual_priority);
+  DEBUG_PRINT("virtual_timeout        = %d\n", cfg->virtual_timeout);
+  DEBUG_PRINT("broadcast_enable       = %d\n", cfg->broadcast_enable);
+  DEBUG_PRINT("follower_enable        = %d\n", cfg->follower_enable);
+  DEBUG_PRINT("follower_leader_id     = %02X:%02X:%02X:%02X:%02X:%02X\n",
+              cfg->follower_leader_id[5], cfg->follower_leader_id[4],
+              cfg->follower_leader_id[3], cfg->follower_leader_id[2],
+              cfg->follower_leader_id[1], cfg->follower_leader_id[0]);
+  DEBUG_PRINT("latency_slo            = %d\n", cfg->latency_slo);
+  DEBUG_PRINT("ridelog_enable         = %d\n", cfg->ridelog_enable);
+  DEBUG_PRINT("ridelog_period         = %d\n", cfg->ridelog_period);
+  DEBUG_PRINT("ridelog_size           = %d\n", cfg->ridelog_size);
+  DEBUG_PRINT("ridelog_trace          = %d\n", cfg->ridelog_trace);
+  DEBUG_PRINT("persist_delay          = %d\n", cfg->persist_delay);
+  DEBUG_PRINT("indicator_colormap     = %d\n", cfg->indicator_colormap);
+  (void) cfg;
 }
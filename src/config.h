@@ -28,9 +28,17 @@
 #define WATCHDOG_TIMEOUT            2000
 #define SERIAL_TIMEOUT              5000
 #define CONFIG_JSON_SIZE            2048
+#define CONFIG_FILTER_SIZE          256
 #define CONFIG_FILENAME             "settings.json"
+#define CONFIG_TEMP_FILENAME        "settings.tmp"
+#define CONFIG_SNAPSHOT_FILENAME    "settings.bin"
+#define CONFIG_SNAPSHOT_MAGIC       0x46534346  // "FCSF"
+#define CONFIG_SNAPSHOT_VERSION     6           // Bump with config_data
+#define CONFIG_MAX_PROFILES         4
+#define CONFIG_NAME_LEN             16
 
 typedef struct {
+    char name[CONFIG_NAME_LEN];         // Profile name
     float speed_max;
     float speed_min;
     float speed_threshold;
@@ -38,11 +46,57 @@ typedef struct {
     unsigned long triac_on_delay;
     uint8_t bt_speed_sensor_id[6];
     uint8_t bt_power_sensor_id[6];
+    uint16_t bt_conn_active_interval;   // ms
+    uint16_t bt_conn_idle_interval;     // ms
+    uint16_t bt_conn_idle_latency;      // connection events
+    uint16_t bt_conn_idle_timeout;      // ms without activity
+    uint16_t bt_conn_timeout;           // ms supervision timeout
+    uint16_t bt_uart_interval;          // ms
+    uint16_t bt_uart_latency;           // connection events
+    uint8_t virtual_priority;           // VIRTUAL_* in sensor.h
+    uint16_t virtual_timeout;           // ms a virtual sample is valid
+    bool broadcast_enable;
+    bool follower_enable;
+    uint8_t follower_leader_id[6];      // Zero for any leader
+    uint16_t latency_slo;               // ms sensor to fan, 0 = none
+    bool ridelog_enable;
+    uint16_t ridelog_period;            // ms between records
+    uint16_t ridelog_size;              // kB preallocated per session
+    bool ridelog_trace;                 // Keep raw sensor notifications
+    uint16_t persist_delay;             // ms quiet before saving, 0 = off
+    uint8_t indicator_colormap;         // COLORMAP_* in colormap.h
 } config_data;
 
-extern config_data config;
+#define CONFIG_OUTPUT_LEVELS        256
 
+// Published config with the tables derived from it
+typedef struct {
+    config_data data;
+    uint32_t generation;
+    uint16_t triac_delay[CONFIG_OUTPUT_LEVELS];  // us for each output
+} config_live;
+
+extern config_live* volatile config_active;
+
+static inline const config_live* config_get_live(void) {
+  return __atomic_load_n(&config_active, __ATOMIC_ACQUIRE);
+}
+
+static inline const config_data* config_get(void) {
+  return &config_get_live()->data;
+}
+
+void config_publish(const config_data *data);
+void config_publish_profiles(const config_data *profiles, int count,
+                             int select);
+int config_profile_select(int index);
+int config_profile_get(void);
+int config_profile_count(void);
+const config_data* config_profile_data(int index);
+uint32_t config_dirty_generation(void);
+uint32_t config_select_generation(void);
 void config_print(void);
 void config_set_defaults(void);
+int config_validate(const config_data *data);
 
 #endif  // SRC_CONFIG_H_
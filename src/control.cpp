@@ -0,0 +1,125 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "hal.h"
+#include "debug.h"
+#include "config.h"
+#include "triac.h"
+#include "indicator.h"
+#include "control.h"
+
+unsigned long control_off_timer = 0;
+uint8_t control_op = 0;
+float control_speed = 0;
+uint8_t control_output[CONTROL_NUM_FANS] = {0, 0};
+volatile int control_override[CONTROL_NUM_FANS] = {CONTROL_AUTO, CONTROL_AUTO};
+
+uint8_t control_calculate(float speed) {
+  const config_data *cfg = config_get();
+  uint8_t op = control_op;
+  if (speed >= cfg->speed_max) {
+    op = 255;
+    control_off_timer = hal_millis();  // Reset each cycle
+  } else if ((speed >= cfg->speed_min) && (speed < cfg->speed_max)) {
+    op = static_cast<uint8_t>(255 * (
+        (speed - cfg->speed_min) / cfg->speed_max));
+    control_off_timer = hal_millis();  // Reset each cycle
+  } else if (speed >= cfg->speed_threshold) {
+    op = 1;
+    control_off_timer = hal_millis();  // Reset each cycle
+  }
+
+  // Check for off timer
+
+  DEBUG_PRINT("off_timer = %ld\n", control_off_timer);
+  unsigned long off_time = hal_millis() - control_off_timer;
+  if ((off_time > CONTROL_OFF_TIMER) && (speed < 1.5)) {
+    DEBUG_PRINT("off_timer countdown = %ld\n", off_time);
+    op = 0;
+  }
+
+  return op;
+}
+
+void control_update(float speed, unsigned long stamp) {
+  // The stamp is the arrival time (micros) of the sensor sample
+  control_speed = speed;
+  control_op = control_calculate(speed);
+  control_apply(stamp);
+}
+
+void control_apply(unsigned long stamp) {
+  for (int i = 0; i < CONTROL_NUM_FANS; i++) {
+    int override = control_override[i];
+    if (override == CONTROL_AUTO) {
+      control_output[i] = control_op;
+    } else {
+      control_output[i] = static_cast<uint8_t>(override);
+    }
+  }
+
+  // Set indicators
+
+  indicator.setLevel(0, control_output[0]);
+  indicator.setLevel(1, control_output[1]);
+
+  // Set the fan output
+  triac_set_output(control_output[0], control_output[1], stamp);
+}
+
+void control_set_override(int fan, int level) {
+  if ((fan < 0) || (fan >= CONTROL_NUM_FANS)) {
+    return;
+  }
+
+  if (level > 255) {
+    level = 255;
+  }
+  if (level < 0) {
+    level = CONTROL_AUTO;
+  }
+
+  DEBUG_PRINT("Fan %d override = %d\n", fan, level);
+  control_override[fan] = level;
+}
+
+int control_get_override(int fan) {
+  if ((fan < 0) || (fan >= CONTROL_NUM_FANS)) {
+    return CONTROL_AUTO;
+  }
+
+  return control_override[fan];
+}
+
+uint8_t control_get_output(int fan) {
+  if ((fan < 0) || (fan >= CONTROL_NUM_FANS)) {
+    return 0;
+  }
+
+  return control_output[fan];
+}
+
+float control_get_speed(void) {
+  return control_speed;
+}
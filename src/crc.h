@@ -0,0 +1,46 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_CRC_H_
+#define SRC_CRC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CRC16_INIT              0xFFFF
+#define CRC32_INIT              0xFFFFFFFF
+
+uint16_t crc16_update(uint16_t crc, const uint8_t *data, size_t len);
+uint16_t crc16_update(uint16_t crc, uint8_t data);
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len);
+
+inline uint16_t crc16(const uint8_t *data, size_t len) {
+  return crc16_update(CRC16_INIT, data, len);
+}
+
+inline uint32_t crc32(const uint8_t *data, size_t len) {
+  return ~crc32_update(CRC32_INIT, data, len);
+}
+
+#endif  // SRC_CRC_H_
@@ -25,13 +25,16 @@
 #ifndef SRC_DEBUG_H_
 #define SRC_DEBUG_H_
 
+#include "logger.h"
+
+// Debug output goes through the deferred logger so it is cheap to call
+// from callbacks and interrupts and never waits on the USB host.
+
 #ifdef DEBUG_OUTPUT
   #define DEBUG_PRINT(fmt, ...) \
-    Serial.printf("%s:%d:%s(): " fmt, \
-            __FILE__, __LINE__, __func__, __VA_ARGS__);
+    LOG_DEBUG(fmt, __VA_ARGS__)
   #define DEBUG_COMMENT(fmt) \
-    Serial.printf("%s:%d:%s(): " fmt, \
-            __FILE__, __LINE__, __func__);
+    LOG_DEBUG(fmt)
 #else
   #define DEBUG_PRINT(fmt, ...) \
       do {} while (0)
@@ -28,6 +28,9 @@
 #include <ArduinoJson.h>
 #include "config.h"
 #include "debug.h"
+#include "sensor.h"
+#include "crc.h"
+#include "colormap.h"
 #include "file.h"
 
 Adafruit_FlashTransport_QSPI flashTransport;
@@ -38,28 +41,120 @@ FatFileSystem fatfs;
 Adafruit_USBD_MSC usb_msc;
 
 bool changed = false;
+unsigned long changed_millis = 0;
+
+// Stamp of the settings.json behind the current config
+config_stamp file_stamp;
+bool file_stamp_valid = false;
+
+// Write behind, generations of config_dirty_generation()
+uint32_t file_persist_seen = 0;
+uint32_t file_persist_saved = 0;
+unsigned long file_persist_millis = 0;
+
+// Read-ahead cache in front of the flash for MSC. Each miss reads
+// MSC_CACHE_BLOCKS from the requested block with one QSPI fast read
+// so that sequential reads from the host are mostly served from RAM.
+
+uint8_t msc_cache[MSC_CACHE_BLOCKS * MSC_BLOCK_SIZE];
+uint32_t msc_cache_lba = 0;
+uint32_t msc_cache_count = 0;     // Valid blocks, zero when empty
+bool msc_dirty = false;           // Writes pending in the flash cache
+msc_stats file_stats = {0, 0, 0, 0, 0, 0};
+msc_stats file_stats_last = {0, 0, 0, 0, 0, 0};
+
+void file_cache_invalidate(void) {
+  msc_cache_count = 0;
+}
+
+static bool msc_cache_fill(uint32_t lba) {
+  uint32_t blocks = flash.size() / MSC_BLOCK_SIZE;
+  if (lba >= blocks) {
+    return false;
+  }
+
+  uint32_t count = blocks - lba;
+  if (count > MSC_CACHE_BLOCKS) {
+    count = MSC_CACHE_BLOCKS;
+  }
+
+  msc_cache_count = 0;
+  if (flash.readBuffer(lba * MSC_BLOCK_SIZE, msc_cache,
+      count * MSC_BLOCK_SIZE) != (count * MSC_BLOCK_SIZE)) {
+    return false;
+  }
+
+  msc_cache_lba = lba;
+  msc_cache_count = count;
+  return true;
+}
 
 // Callback invoked when received READ10 command.
 // Copy disk's data to buffer (up to bufsize) and
 // return number of copied bytes (must be multiple of block size)
 int32_t msc_read_cb(uint32_t lba, void* buffer, uint32_t bufsize) {
-  // Note: SPIFLash Bock API: readBlocks/writeBlocks/syncBlocks
-  // already include 4K sector caching internally.
-  // We don't need to cache it, yahhhh!!
-  return flash.readBlocks(lba, reinterpret_cast<uint8_t*>(buffer),
-    bufsize/512) ? bufsize : -1;
+  unsigned long start = micros();
+  uint8_t *dst = reinterpret_cast<uint8_t*>(buffer);
+  uint32_t nblocks = bufsize / MSC_BLOCK_SIZE;
+
+  if (msc_dirty) {
+    // Make sure the flash holds what the host last wrote
+    flash.syncBlocks();
+    msc_dirty = false;
+  }
+
+  if (nblocks > MSC_CACHE_BLOCKS) {
+    // Large requests go straight to the flash in one read
+    if (flash.readBuffer(lba * MSC_BLOCK_SIZE, dst, bufsize) != bufsize) {
+      return -1;
+    }
+    file_stats.read_misses++;
+  } else {
+    for (uint32_t i = 0; i < nblocks; i++) {
+      uint32_t block = lba + i;
+      if ((block < msc_cache_lba)
+          || (block >= (msc_cache_lba + msc_cache_count))) {
+        if (!msc_cache_fill(block)) {
+          return -1;
+        }
+        file_stats.read_misses++;
+      } else {
+        file_stats.read_hits++;
+      }
+
+      memcpy(&dst[i * MSC_BLOCK_SIZE],
+        &msc_cache[(block - msc_cache_lba) * MSC_BLOCK_SIZE], MSC_BLOCK_SIZE);
+    }
+  }
+
+  file_stats.read_bytes += bufsize;
+  file_stats.read_micros += micros() - start;
+  return bufsize;
 }
 
 // Callback invoked when received WRITE10 command.
 // Process data in buffer to disk's storage and
 // return number of written bytes (must be multiple of block size)
 int32_t msc_write_cb(uint32_t lba, uint8_t* buffer, uint32_t bufsize) {
-  digitalWrite(LED_BUILTIN, HIGH);
+  unsigned long start = micros();
+
+  if (!msc_dirty) {
+    digitalWrite(LED_BUILTIN, HIGH);
+    msc_dirty = true;
+  }
+  changed_millis = millis();
 
   // Note: SPIFLash Bock API: readBlocks/writeBlocks/syncBlocks
-  // already include 4K sector caching internally.
-  // We don't need to cache it, yahhhh!!
-  return flash.writeBlocks(lba, buffer, bufsize/512) ? bufsize : -1;
+  // already coalesce writes into a 4K sector cache, so only the
+  // read-ahead needs to be dropped.
+  file_cache_invalidate();
+  if (!flash.writeBlocks(lba, buffer, bufsize / MSC_BLOCK_SIZE)) {
+    return -1;
+  }
+
+  file_stats.write_bytes += bufsize;
+  file_stats.write_micros += micros() - start;
+  return bufsize;
 }
 
 // Callback invoked when WRITE10 command is completed
@@ -68,38 +163,187 @@ int32_t msc_write_cb(uint32_t lba, uint8_t* buffer, uint32_t bufsize) {
 void msc_flush_cb(void) {
   // sync with flash
   flash.syncBlocks();
+  msc_dirty = false;
 
   // clear file system's cache to force refresh
   fatfs.cacheClear();
 
   digitalWrite(LED_BUILTIN, LOW);
   changed = true;
+  changed_millis = millis();
+}
+
+const msc_stats* file_get_stats(void) {
+  return &file_stats;
+}
+
+static uint32_t file_rate(uint32_t bytes, uint32_t us) {
+  // Bytes per us is MB/s, return kB/s
+  if (!us) {
+    return 0;
+  }
+  return static_cast<uint64_t>(bytes) * 1000 / us;
+}
+
+static void file_print_stats(void) {
+  // Print throughput since the last call if the host was busy
+  uint32_t read = file_stats.read_bytes - file_stats_last.read_bytes;
+  uint32_t written = file_stats.write_bytes - file_stats_last.write_bytes;
+  if (!read && !written) {
+    return;
+  }
+
+  uint32_t read_us = file_stats.read_micros - file_stats_last.read_micros;
+  uint32_t write_us = file_stats.write_micros - file_stats_last.write_micros;
+  uint32_t hits = file_stats.read_hits - file_stats_last.read_hits;
+  uint32_t misses = file_stats.read_misses - file_stats_last.read_misses;
+
+  LOG_INFO("MSC read %lu bytes at %lu kB/s (hits %lu misses %lu)\n",
+    read, file_rate(read, read_us), hits, misses);
+  LOG_INFO("MSC write %lu bytes at %lu kB/s\n",
+    written, file_rate(written, write_us));
+
+  file_stats_last = file_stats;
 }
 
 bool file_data_changed(void) {
-  bool rtn = changed;
+  // Wait until the host has stopped writing before acting on a flush
+  if (!changed || msc_dirty
+      || ((millis() - changed_millis) < FILE_DEBOUNCE)) {
+    return false;
+  }
+
   changed = false;
-  return rtn;
+  return true;
+}
+
+static char* write_mac_address(char *str, const uint8_t *addr) {
+  // Non const so that ArduinoJson keeps a copy
+  snprintf(str, 18, "%02X:%02X:%02X:%02X:%02X:%02X",
+           addr[5], addr[4], addr[3], addr[2], addr[1], addr[0]);
+  return str;
+}
+
+static const char* write_virtual_priority(uint8_t priority) {
+  switch (priority) {
+    case VIRTUAL_OFF:
+      return "off";
+    case VIRTUAL_PREFER:
+      return "prefer";
+    case VIRTUAL_ONLY:
+      return "only";
+    default:
+      return "fallback";
+  }
+}
+
+static const char* write_colormap(uint8_t map) {
+  switch (map) {
+    case COLORMAP_VIRIDIS:
+      return "viridis";
+    case COLORMAP_CUSTOM:
+      return "custom";
+    default:
+      return "hot";
+  }
+}
+
+static void write_profile(JsonObject dst, const config_data *data) {
+  char mac[18];
+  dst["name"] = const_cast<char*>(data->name);
+  dst["speed"]["max"] = data->speed_max;
+  dst["speed"]["min"] = data->speed_min;
+  dst["speed"]["threshold"] = data->speed_threshold;
+  dst["speed"]["sensor_id"] = write_mac_address(mac,
+    data->bt_speed_sensor_id);
+  dst["power"]["sensor_id"] = write_mac_address(mac,
+    data->bt_power_sensor_id);
+  dst["virtual"]["priority"] = write_virtual_priority(data->virtual_priority);
 }
 
 int file_write_config(const char *filename) {
+  // Write the whole config, in the form read by file_read_config(), to
+  // a temporary file which then replaces the original
   DEBUG_PRINT("Writing config file [%s]\n", filename);
-  File myFile = fatfs.open(filename, O_RDWR | O_CREAT);
-  if (!myFile) {
+
+  StaticJsonDocument<CONFIG_JSON_SIZE> doc;
+  const config_data *base = config_profile_data(0);
+
+  char mac[18];
+
+  write_profile(doc.to<JsonObject>(), base);
+  doc["triac"]["off_delay"] = base->triac_off_delay;
+  doc["triac"]["on_delay"] = base->triac_on_delay;
+
+  JsonObject conn = doc["bluetooth"].createNestedObject("conn");
+  conn["active_interval"] = base->bt_conn_active_interval;
+  conn["idle_interval"] = base->bt_conn_idle_interval;
+  conn["idle_latency"] = base->bt_conn_idle_latency;
+  conn["idle_timeout"] = base->bt_conn_idle_timeout;
+  conn["timeout"] = base->bt_conn_timeout;
+  doc["bluetooth"]["uart"]["interval"] = base->bt_uart_interval;
+  doc["bluetooth"]["uart"]["latency"] = base->bt_uart_latency;
+
+  doc["virtual"]["timeout"] = base->virtual_timeout;
+  doc["broadcast"]["enable"] = base->broadcast_enable;
+  doc["follower"]["enable"] = base->follower_enable;
+  doc["follower"]["leader_id"] = write_mac_address(mac,
+    base->follower_leader_id);
+  doc["latency"]["slo"] = base->latency_slo;
+  doc["ridelog"]["enable"] = base->ridelog_enable;
+  doc["ridelog"]["period"] = base->ridelog_period;
+  doc["ridelog"]["size"] = base->ridelog_size;
+  doc["ridelog"]["trace"] = base->ridelog_trace;
+  doc["persist"]["delay"] = base->persist_delay;
+  doc["indicator"]["colormap"] = write_colormap(base->indicator_colormap);
+
+  if (config_profile_count() > 1) {
+    JsonArray list = doc.createNestedArray("profiles");
+    for (int i = 0; i < config_profile_count(); i++) {
+      write_profile(list.createNestedObject(), config_profile_data(i));
+    }
+  }
+  doc["profile"] = const_cast<char*>(config_get()->name);
+  doc["profile_index"] = config_profile_get();
+
+  if (doc.overflowed()) {
+    // A truncated document must not replace the file
+    LOG_ERROR("Config does not fit in %d bytes, not written\n",
+      CONFIG_JSON_SIZE);
+    return -127;
+  }
+
+  File file = fatfs.open(CONFIG_TEMP_FILENAME, O_RDWR | O_CREAT | O_TRUNC);
+  if (!file) {
     DEBUG_COMMENT("Failed to open file.\n");
     return -127;
   }
 
-  StaticJsonDocument<CONFIG_JSON_SIZE> doc;
-  serializeJson(doc, myFile);
-  myFile.println();
-  myFile.close();
+  bool ok = serializeJsonPretty(doc, file) > 0;
+  file.println();
+  ok = file.sync() && ok;
+  file.close();
+
+  // FAT can not rename over a file, so a crash between the two steps
+  // leaves only the temporary file which file_setup() recovers
+  if (!ok || (fatfs.exists(filename) && !fatfs.remove(filename))
+      || !fatfs.rename(CONFIG_TEMP_FILENAME, filename)) {
+    DEBUG_COMMENT("Failed to write config file.\n");
+    file_cache_invalidate();
+    return -127;
+  }
+  file_cache_invalidate();
 
   return 0;
 }
 
 void read_mac_address(const char *str, uint8_t *addr) {
-  int mac[6];
+  int mac[6] = {0, 0, 0, 0, 0, 0};
+  if (!str) {
+    memset(addr, 0, 6);
+    return;
+  }
+
   sscanf(str, "%X:%X:%X:%X:%X:%X",
          &mac[5], &mac[4], &mac[3], &mac[2], &mac[1], &mac[0]);
   for (int i = 0; i < 6; i++) {
@@ -107,34 +351,338 @@ void read_mac_address(const char *str, uint8_t *addr) {
   }
 }
 
+uint8_t read_virtual_priority(const char *str) {
+  if (!str) {
+    return VIRTUAL_FALLBACK;
+  }
+  if (!strcmp(str, "off")) {
+    return VIRTUAL_OFF;
+  }
+  if (!strcmp(str, "prefer")) {
+    return VIRTUAL_PREFER;
+  }
+  if (!strcmp(str, "only")) {
+    return VIRTUAL_ONLY;
+  }
+
+  return VIRTUAL_FALLBACK;
+}
+
+uint8_t read_colormap(const char *str) {
+  if (str && !strcmp(str, "viridis")) {
+    return COLORMAP_VIRIDIS;
+  }
+  if (str && !strcmp(str, "custom")) {
+    return COLORMAP_CUSTOM;
+  }
+
+  return COLORMAP_HOT;
+}
+
+void read_profile(JsonVariant profile, config_data *data) {
+  // Only the keys given in the profile are changed
+  if (profile["name"]) {
+    snprintf(data->name, CONFIG_NAME_LEN, "%s",
+      profile["name"].as<char *>());
+  }
+
+  JsonVariant speed = profile["speed"];
+  data->speed_max = speed["max"] | data->speed_max;
+  data->speed_min = speed["min"] | data->speed_min;
+  data->speed_threshold = speed["threshold"] | data->speed_threshold;
+  if (speed["sensor_id"]) {
+    read_mac_address(speed["sensor_id"].as<char *>(),
+      data->bt_speed_sensor_id);
+  }
+
+  if (profile["power"]["sensor_id"]) {
+    read_mac_address(profile["power"]["sensor_id"].as<char *>(),
+      data->bt_power_sensor_id);
+  }
+
+  if (profile["virtual"]["priority"]) {
+    data->virtual_priority = read_virtual_priority(
+      profile["virtual"]["priority"].as<char *>());
+  }
+}
+
+static int file_get_stamp(const char *filename, config_stamp *stamp) {
+  File file = fatfs.open(filename, O_RDONLY);
+  if (!file) {
+    return -127;
+  }
+
+  stamp->size = file.fileSize();
+  if (!file.getModifyDateTime(&stamp->date, &stamp->time)) {
+    stamp->date = 0;
+    stamp->time = 0;
+  }
+
+  // The device has no clock so the mtime alone is not enough
+  uint8_t buffer[MSC_BLOCK_SIZE];
+  uint32_t crc = CRC32_INIT;
+  int n;
+  while ((n = file.read(buffer, sizeof(buffer))) > 0) {
+    crc = crc32_update(crc, buffer, n);
+  }
+  stamp->crc = ~crc;
+
+  file.close();
+  return 0;
+}
+
+static bool file_stamp_equal(const config_stamp *a, const config_stamp *b) {
+  return (a->size == b->size) && (a->date == b->date)
+    && (a->time == b->time) && (a->crc == b->crc);
+}
+
+static int file_write_snapshot(const config_stamp *stamp) {
+  config_snapshot snapshot;
+  snapshot.magic = CONFIG_SNAPSHOT_MAGIC;
+  snapshot.version = CONFIG_SNAPSHOT_VERSION;
+  snapshot.length = sizeof(config_data);
+  snapshot.stamp = *stamp;
+  snapshot.count = config_profile_count();
+  snapshot.select = config_profile_get();
+  snapshot.reserved = 0;
+
+  uint32_t crc = crc32_update(CRC32_INIT,
+    reinterpret_cast<const uint8_t*>(&snapshot),
+    offsetof(config_snapshot, crc));
+  for (int i = 0; i < snapshot.count; i++) {
+    crc = crc32_update(crc,
+      reinterpret_cast<const uint8_t*>(config_profile_data(i)),
+      sizeof(config_data));
+  }
+  snapshot.crc = ~crc;
+
+  File file = fatfs.open(CONFIG_SNAPSHOT_FILENAME,
+    O_RDWR | O_CREAT | O_TRUNC);
+  if (!file) {
+    DEBUG_COMMENT("Failed to open snapshot file.\n");
+    return -127;
+  }
+
+  bool ok = (file.write(&snapshot, sizeof(snapshot)) == sizeof(snapshot));
+  for (int i = 0; ok && (i < snapshot.count); i++) {
+    ok = file.write(config_profile_data(i), sizeof(config_data))
+      == sizeof(config_data);
+  }
+  file.close();
+  file_cache_invalidate();
+
+  if (!ok) {
+    DEBUG_COMMENT("Failed to write snapshot file.\n");
+    return -127;
+  }
+
+  DEBUG_COMMENT("Wrote config snapshot\n");
+  return 0;
+}
+
+int file_load_snapshot(void) {
+  // Load the config saved from the last parse of settings.json, so
+  // the JSON only has to be parsed when it has changed
+  unsigned long start = micros();
+
+  config_stamp stamp;
+  if (file_get_stamp(CONFIG_FILENAME, &stamp)) {
+    return -127;
+  }
+
+  File file = fatfs.open(CONFIG_SNAPSHOT_FILENAME, O_RDONLY);
+  if (!file) {
+    DEBUG_COMMENT("No config snapshot\n");
+    return -127;
+  }
+
+  config_snapshot snapshot;
+  config_data profiles[CONFIG_MAX_PROFILES];
+  bool ok = (file.read(&snapshot, sizeof(snapshot)) == sizeof(snapshot))
+    && (snapshot.magic == CONFIG_SNAPSHOT_MAGIC)
+    && (snapshot.version == CONFIG_SNAPSHOT_VERSION)
+    && (snapshot.length == sizeof(config_data))
+    && (snapshot.count >= 1) && (snapshot.count <= CONFIG_MAX_PROFILES)
+    && (snapshot.select < snapshot.count);
+
+  uint32_t crc = crc32_update(CRC32_INIT,
+    reinterpret_cast<const uint8_t*>(&snapshot),
+    offsetof(config_snapshot, crc));
+  for (int i = 0; ok && (i < snapshot.count); i++) {
+    ok = file.read(&profiles[i], sizeof(config_data)) == sizeof(config_data);
+    crc = crc32_update(crc, reinterpret_cast<const uint8_t*>(&profiles[i]),
+      sizeof(config_data));
+  }
+  file.close();
+
+  if (!ok || (~crc != snapshot.crc)) {
+    DEBUG_COMMENT("Config snapshot invalid\n");
+    return -127;
+  }
+
+  if (!file_stamp_equal(&stamp, &snapshot.stamp)) {
+    DEBUG_COMMENT("Config snapshot out of date\n");
+    return -127;
+  }
+
+  for (int i = 0; i < snapshot.count; i++) {
+    if (config_validate(&profiles[i])) {
+      DEBUG_COMMENT("Config snapshot failed validation\n");
+      return -127;
+    }
+  }
+  config_publish_profiles(profiles, snapshot.count, snapshot.select);
+  file_stamp = stamp;
+  file_stamp_valid = true;
+  changed = false;  // No need to parse on the first loop
+
+  DEBUG_PRINT("Loaded config snapshot in %lu us\n", micros() - start);
+  (void) start;
+  return 0;
+}
+
 int file_read_config(const char* filename) {
   // Allocate
   StaticJsonDocument<CONFIG_JSON_SIZE> doc;
 
+  // Only keep the sections we use, anything else in the file is
+  // skipped while streaming and does not take space in the document
+  StaticJsonDocument<CONFIG_FILTER_SIZE> filter;
+  filter["speed"] = true;
+  filter["power"] = true;
+  filter["triac"] = true;
+  filter["bluetooth"] = true;
+  filter["virtual"] = true;
+  filter["broadcast"] = true;
+  filter["follower"] = true;
+  filter["latency"] = true;
+  filter["ridelog"] = true;
+  filter["persist"] = true;
+  filter["indicator"] = true;
+  filter["name"] = true;
+  filter["profiles"] = true;
+  filter["profile"] = true;
+  filter["profile_index"] = true;
+
   DEBUG_PRINT("Reading config file [%s]\n", filename);
   File file = fatfs.open(filename, O_RDONLY);
   if (file) {
-    DeserializationError error = deserializeJson(doc, file);
+    DeserializationError error = deserializeJson(doc, file,
+      DeserializationOption::Filter(filter));
+    file.close();
     if (error) {
       DEBUG_COMMENT("Failed to parse JSON\n");
       DEBUG_PRINT("Error = %s\n", error.c_str());
       return -127;
     }
 
-    // Now load the structs
+    // Load into a staging copy, only committed if valid
+    config_data staging = *config_get();
 
-    config.speed_max = doc["speed"]["max"] | 15.0;
-    config.speed_min = doc["speed"]["min"] | 5.0;
-    config.speed_threshold = doc["speed"]["threshold"] | 1.5;
-    config.triac_off_delay = doc["triac"]["off_delay"] | 0L;
-    config.triac_on_delay = doc["triac"]["on_delay"] | 0L;
+    snprintf(staging.name, CONFIG_NAME_LEN, "%s",
+      doc["name"] | "default");
+    staging.speed_max = doc["speed"]["max"] | 15.0;
+    staging.speed_min = doc["speed"]["min"] | 5.0;
+    staging.speed_threshold = doc["speed"]["threshold"] | 1.5;
+    staging.triac_off_delay = doc["triac"]["off_delay"] | 4000L;
+    staging.triac_on_delay = doc["triac"]["on_delay"] | 1L;
 
     // Process mac addresses
     read_mac_address(doc["speed"]["sensor_id"].as<char *>(),
-      config.bt_speed_sensor_id);
+      staging.bt_speed_sensor_id);
 
     read_mac_address(doc["power"]["sensor_id"].as<char *>(),
-      config.bt_power_sensor_id);
+      staging.bt_power_sensor_id);
+
+    // Connection parameters (ms)
+    JsonVariant conn = doc["bluetooth"]["conn"];
+    staging.bt_conn_active_interval = conn["active_interval"] | 15;
+    staging.bt_conn_idle_interval = conn["idle_interval"] | 100;
+    staging.bt_conn_idle_latency = conn["idle_latency"] | 4;
+    staging.bt_conn_idle_timeout = conn["idle_timeout"] | 10000;
+    staging.bt_conn_timeout = conn["timeout"] | 4000;
+    staging.bt_uart_interval = doc["bluetooth"]["uart"]["interval"] | 30;
+    staging.bt_uart_latency = doc["bluetooth"]["uart"]["latency"] | 0;
+
+    // Virtual sensor
+    staging.virtual_priority = read_virtual_priority(
+      doc["virtual"]["priority"].as<char *>());
+    staging.virtual_timeout = doc["virtual"]["timeout"] | 2000;
+
+    // Broadcast and follower
+    staging.broadcast_enable = doc["broadcast"]["enable"] | true;
+    staging.follower_enable = doc["follower"]["enable"] | false;
+    if (doc["follower"]["leader_id"]) {
+      read_mac_address(doc["follower"]["leader_id"].as<char *>(),
+        staging.follower_leader_id);
+    } else {
+      memset(staging.follower_leader_id, 0, 6);
+    }
+
+    staging.latency_slo = doc["latency"]["slo"] | 0;
+
+    // Ride log
+    staging.ridelog_enable = doc["ridelog"]["enable"] | false;
+    staging.ridelog_period = doc["ridelog"]["period"] | 1000;
+    staging.ridelog_size = doc["ridelog"]["size"] | 256;
+    staging.ridelog_trace = doc["ridelog"]["trace"] | false;
+    staging.persist_delay = doc["persist"]["delay"] | 10000;
+    staging.indicator_colormap = read_colormap(
+      doc["indicator"]["colormap"].as<char *>());
+
+    // Profiles start from the settings above and override them
+    config_data profiles[CONFIG_MAX_PROFILES];
+    int count = 0;
+    JsonArray list = doc["profiles"];
+    for (size_t i = 0; (i < list.size()) && (count < CONFIG_MAX_PROFILES);
+         i++) {
+      profiles[count] = staging;
+      read_profile(list[i], &profiles[count]);
+      count++;
+    }
+    if (!count) {
+      profiles[count++] = staging;
+    }
+
+    // Profiles may share a name (unnamed ones inherit the top level
+    // one), so a saved file also has the index. A file edited by hand
+    // may only give the name, the first match is taken.
+    int select = -1;
+    const char *name = doc["profile"] | "";
+    int index = doc["profile_index"] | -1;
+    if ((index >= 0) && (index < count)
+        && (!*name || !strcmp(name, profiles[index].name))) {
+      select = index;
+    }
+    for (int i = 0; (select < 0) && (i < count); i++) {
+      if (!strcmp(name, profiles[i].name)) {
+        select = i;
+      }
+    }
+    if (select < 0) {
+      select = 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+      if (config_validate(&profiles[i])) {
+        DEBUG_PRINT("Invalid config in profile %d, keeping the current one\n",
+          i);
+        return -127;
+      }
+    }
+    config_publish_profiles(profiles, count, select);
+
+    // The file wins over runtime changes not yet written back
+    file_persist_seen = config_dirty_generation();
+    file_persist_saved = file_persist_seen;
+
+    // Save a snapshot for the next boot
+    config_stamp stamp;
+    if (!file_get_stamp(filename, &stamp)) {
+      file_stamp = stamp;
+      file_stamp_valid = true;
+      file_write_snapshot(&stamp);
+    }
 
     // Print out config
 
@@ -147,11 +695,67 @@ int file_read_config(const char* filename) {
   return 0;
 }
 
-void file_loop(void) {
+static void file_persist(void) {
+  // Write behind of runtime config changes. Changes are coalesced until
+  // none have been made for persist_delay ms.
+  uint32_t generation = config_dirty_generation();
+  if (generation != file_persist_seen) {
+    file_persist_seen = generation;
+    file_persist_millis = millis();
+  }
+
+  uint16_t delay = config_get()->persist_delay;
+  if ((file_persist_seen == file_persist_saved) || !delay
+      || ((millis() - file_persist_millis) < delay)) {
+    return;
+  }
+
+  if (msc_dirty || changed) {
+    // Let the host finish and any reload happen first
+    return;
+  }
+
+  if (USBDevice.mounted()) {
+    // The host caches the FAT and directory, changing them under it can
+    // corrupt the volume on its next write. Wait until it is unplugged.
+    return;
+  }
+
+  if (file_write_config(CONFIG_FILENAME)) {
+    // Try again after another delay
+    file_persist_millis = millis();
+    return;
+  }
+  file_persist_saved = file_persist_seen;
+
+  // Record the new file so it is not parsed again, and snapshot it
+  config_stamp stamp;
+  if (!file_get_stamp(CONFIG_FILENAME, &stamp)) {
+    file_stamp = stamp;
+    file_stamp_valid = true;
+    file_write_snapshot(&stamp);
+  }
+}
+
+bool file_loop(void) {
+  file_print_stats();
+  file_persist();
+
   if (file_data_changed()) {
     DEBUG_COMMENT("Filesystem Changed\n");
-    file_read_config(CONFIG_FILENAME);
+
+    // Only parse the JSON if it differs from the current config
+    config_stamp stamp;
+    if (file_stamp_valid && !file_get_stamp(CONFIG_FILENAME, &stamp)
+        && file_stamp_equal(&stamp, &file_stamp)) {
+      DEBUG_COMMENT("Config unchanged\n");
+      return false;
+    }
+
+    return !file_read_config(CONFIG_FILENAME);
   }
+
+  return false;
 }
 
 FatFileSystem file_setup(void) {
@@ -180,6 +784,12 @@ FatFileSystem file_setup(void) {
   DEBUG_PRINT("JEDEC ID: 0x%X\n", flash.getJEDECID());
   DEBUG_PRINT("Flash size: %d\n", flash.size());
 
+  // Finish a config write interrupted by a reset
+  if (!fatfs.exists(CONFIG_FILENAME) && fatfs.exists(CONFIG_TEMP_FILENAME)) {
+    DEBUG_COMMENT("Recovering config file\n");
+    fatfs.rename(CONFIG_TEMP_FILENAME, CONFIG_FILENAME);
+  }
+
   changed = true;  // Trigger on setup
 
   StaticJsonDocument<200> doc;
@@ -27,7 +27,44 @@
 
 #include <SdFat.h>
 
+#define MSC_BLOCK_SIZE          512
+#define MSC_CACHE_BLOCKS        16    // Read-ahead of 8 kB
+#define FILE_DEBOUNCE           1000  // ms after the last host write
+
+typedef struct {
+  uint32_t read_bytes;
+  uint32_t read_micros;
+  uint32_t read_hits;               // Blocks served from the cache
+  uint32_t read_misses;             // Reads from the flash
+  uint32_t write_bytes;
+  uint32_t write_micros;
+} msc_stats;
+
+// Identifies the settings.json a config snapshot was made from
+typedef struct {
+  uint32_t size;
+  uint16_t date;
+  uint16_t time;
+  uint32_t crc;
+} config_stamp;
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t length;                  // sizeof(config_data)
+  config_stamp stamp;
+  uint8_t count;                    // Profiles that follow
+  uint8_t select;                   // Selected profile
+  uint16_t reserved;
+  uint32_t crc;                     // CRC32 of the header and profiles
+} config_snapshot;
+
+extern FatFileSystem fatfs;
+
 FatFileSystem file_setup(void);
-void file_loop(void);
+bool file_loop(void);
+int file_load_snapshot(void);
+void file_cache_invalidate(void);
+const msc_stats* file_get_stats(void);
 
 #endif  // SRC_FILE_H_
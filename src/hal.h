@@ -0,0 +1,102 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_HAL_H_
+#define SRC_HAL_H_
+
+#include <stdint.h>
+
+// Hardware used by the control, sensor, triac and command code. On the
+// nRF52 these are inlines over the Arduino core and compile to the same
+// calls as before. The host build (env:native) gets them from
+// native/hal_native.h, where time is a virtual clock and the pins and
+// timers are driven by the host program.
+//
+// The timer is InterruptTimer from inttimer.h, the host version has the
+// same interface. Bluetooth and the filesystem stay behind bluetooth.h
+// and file.h.
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include "inttimer.h"
+
+static inline unsigned long hal_millis(void) {
+  return millis();
+}
+
+static inline unsigned long hal_micros(void) {
+  return micros();
+}
+
+static inline void hal_delay_us(unsigned long us) {
+  delayMicroseconds(us);
+}
+
+static inline void hal_pin_write(int pin, bool level) {
+  digitalWrite(pin, level ? HIGH : LOW);
+}
+
+static inline bool hal_pin_read(int pin) {
+  return digitalRead(pin) == HIGH;
+}
+
+static inline void hal_attach_isr(int pin, void (*isr)(void)) {
+  // Called on both edges
+  attachInterrupt(digitalPinToInterrupt(pin), isr, CHANGE);
+}
+
+static inline void hal_cycles_setup(void) {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t hal_cycles(void) {
+  return DWT->CYCCNT;
+}
+
+static inline uint32_t hal_cycles_per_us(void) {
+  return SystemCoreClock / 1000000;
+}
+
+static inline bool hal_console_ready(void) {
+  return Serial;
+}
+
+static inline int hal_console_space(void) {
+  return Serial.availableForWrite();
+}
+
+static inline void hal_console_write(const char *buf, int len) {
+  Serial.write(reinterpret_cast<const uint8_t*>(buf), len);
+}
+
+#else
+
+#include "native/hal_native.h"
+
+#endif
+
+#endif  // SRC_HAL_H_
@@ -0,0 +1,88 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_HISTOGRAM_H_
+#define SRC_HISTOGRAM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+// Min / max / mean and a log2 histogram of a quantity. Recording is
+// not locked, so each histogram must only be written from one context.
+
+#define HISTOGRAM_BINS          32
+
+typedef struct {
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+  uint32_t hist[HISTOGRAM_BINS];
+} histogram;
+
+static inline void histogram_reset(histogram *h) {
+  memset(h, 0, sizeof(histogram));
+  h->min = 0xFFFFFFFF;
+}
+
+static inline void histogram_record(histogram *h, uint32_t val) {
+  h->count++;
+  h->sum += val;
+  if (val < h->min) {
+    h->min = val;
+  }
+  if (val > h->max) {
+    h->max = val;
+  }
+
+  int bin = val ? (31 - __builtin_clz(val)) : 0;
+  h->hist[bin]++;
+}
+
+static inline uint32_t histogram_mean(const histogram *h) {
+  return h->count ? static_cast<uint32_t>(h->sum / h->count) : 0;
+}
+
+// Pack as u32 count, min, max and mean followed by the histogram as
+// saturated u16s, returns the number of bytes written
+
+static inline int histogram_pack(uint8_t *buf, const histogram *h) {
+  uint32_t vals[4] = {h->count, h->count ? h->min : 0, h->max,
+                      histogram_mean(h)};
+  for (int i = 0; i < 4; i++) {
+    buf[(i * 4)] = vals[i] & 0xFF;
+    buf[(i * 4) + 1] = (vals[i] >> 8) & 0xFF;
+    buf[(i * 4) + 2] = (vals[i] >> 16) & 0xFF;
+    buf[(i * 4) + 3] = (vals[i] >> 24) & 0xFF;
+  }
+  for (int i = 0; i < HISTOGRAM_BINS; i++) {
+    uint32_t n = h->hist[i] > 0xFFFF ? 0xFFFF : h->hist[i];
+    buf[16 + (i * 2)] = n & 0xFF;
+    buf[17 + (i * 2)] = n >> 8;
+  }
+
+  return 16 + (HISTOGRAM_BINS * 2);
+}
+
+#endif  // SRC_HISTOGRAM_H_
@@ -24,104 +24,263 @@
 
 #include <Arduino.h>
 #include <Adafruit_NeoPixel.h>
-#include "inttimer.h"
 #include "wiring.h"
 #include "debug.h"
 #include "indicator.h"
+#include "config.h"
 #include "colormap.h"
+#include "levelbar.h"
+#include "profile.h"
+
+// The animations are evaluated in render(), which is called from
+// loop(), or from a FreeRTOS software timer while setup() blocks, and
+// sends a frame to the LEDs at most once per
+// INDICATOR_FRAME_PERIOD and only if something changed. On the nRF52
+// Adafruit_NeoPixel::show() drives the data line from a PWM peripheral
+// with EasyDMA, but it still waits for the transfer to finish so it is
+// kept out of interrupt context.
+
+// Gamma table generated at compile time, see colormap.h. The level bars
+// are drawn by levelbar.h.
+
+static constexpr gamma_table<COLORMAP_GAMMA, INDICATOR_BRIGHTNESS>
+  status_gamma;
+
+static const indicator_keyframe anim_solid[] = {
+  {255, 0}
+};
+
+static const indicator_keyframe anim_off[] = {
+  {0, 0}
+};
+
+static const indicator_keyframe anim_pulse[] = {
+  {0, 0}, {255, 500}, {0, 500}
+};
+
+static const indicator_keyframe anim_sweep[] = {
+  {0, 0}, {255, 512}, {0, 512}
+};
+
+// Renders while setup() blocks, e.g. in bluetooth_setup()
+static SoftwareTimer indicator_timer;
+static volatile bool indicator_background = false;
+static bool indicator_timer_created = false;
+
+static void indicator_timer_callback(TimerHandle_t timer) {
+  (void) timer;
+  if (indicator_background) {
+    indicator.render();
+  }
+}
 
 NeoPixelIndicator::NeoPixelIndicator(void) {
   neopixel = new Adafruit_NeoPixel(1, PIN_NEOPIXEL, NEO_GRB);
-  strip = new Adafruit_NeoPixel(12, PIN_STRIP, NEO_RGB);
-  timer = new TimerClass(3);
-
-  timer->init(100000);
-  timer->setCallback(NeoPixelIndicator::callback, this);
+  strip = new Adafruit_NeoPixel(INDICATOR_STRIP_PIXELS, PIN_STRIP, NEO_RGB);
 
-  ticktock = 0;
-  neopixelFlash = 1;
+  frameMillis = 0;
+  frameCount = 0;
+  neopixelStatus = OFF;
+  neopixelFlash = 0;
+  neopixelShown = 0xFFFFFFFF;
+  for (int i = 0; i < NUM_TRACKS; i++) {
+    tracks[i].value = 0;
+    play(i, anim_off, 1, 0);
+  }
+  levelTarget[0] = 0;
+  levelTarget[1] = 0;
+  for (int i = 0; i < INDICATOR_STRIP_PIXELS; i++) {
+    stripFrame[i] = 0;
+  }
+  stripDirty = false;
 }
 
 NeoPixelIndicator::~NeoPixelIndicator(void) {
   delete neopixel;
   delete strip;
-  delete timer;
 }
 
 void NeoPixelIndicator::begin(void) {
-  timer->start();
   neopixel->begin();
   neopixel->show();
   strip->begin();
   strip->show();
+
+  // So the first render() draws straight away
+  frameMillis = millis() - INDICATOR_FRAME_PERIOD;
 }
 
-void NeoPixelIndicator::timerTick(void) {
-  if (!neopixelFlash) {
-    // no flash
-    if (neopixelCurrentStatus != neopixelStatus) {
-      neopixelCurrentStatus = neopixelStatus;
-      neopixel->setBrightness(20);
-      neopixel->setPixelColor(0, neopixelStatus);
-      neopixel->show();
+void NeoPixelIndicator::renderInBackground(bool enable) {
+  // Only render() is called from the timer, nothing else may use the
+  // indicator until it is disabled again
+  if (enable) {
+    indicator_background = true;
+    if (!indicator_timer_created) {
+      indicator_timer.begin(INDICATOR_FRAME_PERIOD, indicator_timer_callback);
+      indicator_timer_created = true;
     }
+    indicator_timer.start();
   } else {
-    if (!(ticktock % neopixelFlash)) {
-      if (neopixelCurrentStatus) {
-        neopixelCurrentStatus = 0;
-        neopixel->setBrightness(20);
-        neopixel->setPixelColor(0, 0);
-      } else {
-        neopixelCurrentStatus = neopixelStatus;
-        neopixel->setBrightness(20);
-        neopixel->setPixelColor(0, neopixelStatus);
-      }
-      neopixel->show();
+    indicator_timer.stop();
+    indicator_background = false;
+  }
+}
+
+void NeoPixelIndicator::play(int track, const indicator_keyframe *frames,
+                             uint8_t count, uint8_t flags) {
+  indicator_track *t = &tracks[track];
+  t->frames = frames;
+  t->count = count;
+  t->flags = flags;
+  t->start = millis();
+  t->done = false;
+}
+
+uint8_t NeoPixelIndicator::evaluate(indicator_track *track,
+                                    unsigned long now) {
+  if (track->done) {
+    return track->value;
+  }
+
+  uint32_t total = 0;
+  for (int i = 1; i < track->count; i++) {
+    total += track->frames[i].duration;
+  }
+
+  uint32_t elapsed = now - track->start;
+  if (!total || (!(track->flags & INDICATOR_LOOP) && (elapsed >= total))) {
+    track->value = track->frames[track->count - 1].value;
+    track->done = !(track->flags & INDICATOR_LOOP);
+    return track->value;
+  }
+  elapsed %= total;
+
+  // Find the segment and interpolate in 8 bit fixed point
+  for (int i = 1; i < track->count; i++) {
+    uint16_t duration = track->frames[i].duration;
+    if (elapsed < duration) {
+      int from = track->frames[i - 1].value;
+      int to = track->frames[i].value;
+      uint32_t t = (elapsed << 8) / duration;
+      track->value = from + (((to - from) * static_cast<int>(t)) >> 8);
+      break;
     }
+    elapsed -= duration;
   }
-  ticktock++;
+
+  return track->value;
 }
 
-void NeoPixelIndicator::startupEffect(void) {
-  for (int i = 0; i < 256; i++) {
-    setLevel(0, i);
-    setLevel(1, i);
-    delay(2);
+void NeoPixelIndicator::render(void) {
+  unsigned long now = millis();
+  if ((now - frameMillis) < INDICATOR_FRAME_PERIOD) {
+    return;
   }
-  for (int i = 0; i < 256; i++) {
-    setLevel(0, 255 - i);
-    setLevel(1, 255 - i);
-    delay(2);
+
+  PROFILE_START();
+
+  // Status LED is the status color scaled by the track, the gamma
+  // table also applies the brightness
+  uint32_t scale = evaluate(&tracks[TRACK_STATUS], now) + 1;
+  uint32_t color =
+    (status_gamma[(neopixelStatus >> 16 & 0xFF) * scale >> 8] << 16)
+    | (status_gamma[(neopixelStatus >> 8 & 0xFF) * scale >> 8] << 8)
+    | status_gamma[(neopixelStatus & 0xFF) * scale >> 8];
+  if (color != neopixelShown) {
+    neopixelShown = color;
+    neopixel->setPixelColor(0, color);
+    neopixel->show();
+  }
+
+  for (int i = 0; i < 2; i++) {
+    indicator_track *track = &tracks[TRACK_LEVEL_0 + i];
+    bool held = !track->done && (track->flags & INDICATOR_HOLD);
+    drawLevel(i, evaluate(track, now));
+    if (held && track->done) {
+      // Move to the level set while the animation was playing
+      fade(i, levelTarget[i]);
+    }
+  }
+
+  if (stripDirty) {
+    stripDirty = false;
+    for (int i = 0; i < INDICATOR_STRIP_PIXELS; i++) {
+      strip->setPixelColor(i, stripFrame[i]);
+    }
+    strip->show();
   }
+
+  frameMillis = now;
+  frameCount++;
+
+  PROFILE_END(PROFILE_INDICATOR);
+}
+
+void NeoPixelIndicator::startupEffect(void) {
+  // Runs from render(), see renderInBackground() for setup
+  play(TRACK_LEVEL_0, anim_sweep, 3, INDICATOR_HOLD);
+  play(TRACK_LEVEL_1, anim_sweep, 3, INDICATOR_HOLD);
 }
 
 void NeoPixelIndicator::setStatus(int status, int flash) {
+  if ((status == neopixelStatus) && (flash == neopixelFlash)) {
+    return;
+  }
   neopixelStatus = status;
   neopixelFlash = flash;
+
+  if (flash == INDICATOR_PULSE) {
+    play(TRACK_STATUS, anim_pulse, 3, INDICATOR_LOOP);
+  } else if (flash > 0) {
+    // On and off for flash periods of 100 ms each
+    uint16_t period = flash * 100;
+    blinkFrames[0] = {255, 0};
+    blinkFrames[1] = {255, period};
+    blinkFrames[2] = {0, 0};
+    blinkFrames[3] = {0, period};
+    play(TRACK_STATUS, blinkFrames, 4, INDICATOR_LOOP);
+  } else {
+    play(TRACK_STATUS, anim_solid, 1, 0);
+  }
 }
 
 void NeoPixelIndicator::setLevel(int display, uint8_t level) {
-  // Level is from 0 to 255.
+  // Level is from 0 to 255, the bar fades to the new level
+  if ((display != 0) && (display != 1)) {
+    return;
+  }
 
-  int h = (level * 6 / 256 + 1);
+  if (level == levelTarget[display]) {
+    return;
+  }
+  levelTarget[display] = level;
 
-  // strip->setBrightness(255);
-  if (display == 0) {
-    for (int i = 0; i < h; i++) {
-      strip->setPixelColor(i, colormap[level]);
-    }
-    for (int i = h; i < 6; i++) {
-      strip->setPixelColor(i, 0);
-    }
-  } else if (display == 1) {
-    for (int i = 0; i < h; i++) {
-      strip->setPixelColor(11 - i, colormap[level]);
-    }
-    for (int i = h; i < 6; i++) {
-      strip->setPixelColor(11 - i, 0);
+  indicator_track *track = &tracks[TRACK_LEVEL_0 + display];
+  if (track->done || !(track->flags & INDICATOR_HOLD)) {
+    fade(display, level);
+  }
+}
+
+void NeoPixelIndicator::fade(int display, uint8_t level) {
+  // Start from wherever the bar is now
+  indicator_track *track = &tracks[TRACK_LEVEL_0 + display];
+  fadeFrames[display][0] = {track->value, 0};
+  fadeFrames[display][1] = {level, INDICATOR_LEVEL_FADE};
+  play(TRACK_LEVEL_0 + display, fadeFrames[display], 2, 0);
+}
+
+void NeoPixelIndicator::drawLevel(int display, uint8_t level) {
+  // Only the frame buffer is changed here
+  uint32_t bar[INDICATOR_BAR_PIXELS];
+  levelbar_draw(bar, config_get()->indicator_colormap, level, frameCount);
+
+  for (int i = 0; i < INDICATOR_BAR_PIXELS; i++) {
+    int pixel = display ? (INDICATOR_STRIP_PIXELS - 1 - i) : i;
+    if (stripFrame[pixel] != bar[i]) {
+      stripFrame[pixel] = bar[i];
+      stripDirty = true;
     }
   }
-  strip->show();
 }
 
 NeoPixelIndicator indicator;
@@ -25,8 +25,39 @@
 #ifndef SRC_INDICATOR_H_
 #define SRC_INDICATOR_H_
 
-#include <Adafruit_NeoPixel.h>
-#include "inttimer.h"
+#include <stdint.h>
+
+class Adafruit_NeoPixel;
+
+#define INDICATOR_STRIP_PIXELS    12
+#define INDICATOR_BAR_PIXELS      6     // Pixels per fan
+#define INDICATOR_DITHER_MAX      32    // Dither channels below this
+#define INDICATOR_FRAME_PERIOD    20    // ms, at most 50 frames/s
+#define INDICATOR_BRIGHTNESS      20
+#define INDICATOR_LEVEL_FADE      250   // ms to move a level bar
+#define INDICATOR_PULSE           -1    // Flash value for a smooth pulse
+
+// Keyframe animation. A track moves from the value of one keyframe to
+// the next over the duration of the next one, so the first keyframe
+// only sets the starting value and a zero duration is a jump. Values
+// are 0 - 255, either a level or the brightness of the status color.
+
+#define INDICATOR_LOOP            0x01  // Repeat the track
+#define INDICATOR_HOLD            0x02  // Levels wait for the end
+
+typedef struct {
+  uint8_t value;
+  uint16_t duration;                    // ms
+} indicator_keyframe;
+
+typedef struct {
+  const indicator_keyframe *frames;
+  uint8_t count;
+  uint8_t flags;
+  unsigned long start;
+  uint8_t value;                        // Last evaluated value
+  bool done;
+} indicator_track;
 
 class NeoPixelIndicator {
  public:
@@ -42,19 +73,34 @@ class NeoPixelIndicator {
   void setStatus(int status, int flash = 1);
   void setLevel(int display, uint8_t level);
   void startupEffect(void);
-  void timerTick(void);
-  static void callback(void* ctx) {
-    static_cast<NeoPixelIndicator*>(ctx)->timerTick();
-  }
+  void render(void);
+  void renderInBackground(bool enable);
 
  private:
-  TimerClass *timer;
+  enum {
+    TRACK_STATUS = 0,
+    TRACK_LEVEL_0,
+    TRACK_LEVEL_1,
+    NUM_TRACKS
+  };
+  void play(int track, const indicator_keyframe *frames, uint8_t count,
+            uint8_t flags);
+  uint8_t evaluate(indicator_track *track, unsigned long now);
+  void fade(int display, uint8_t level);
+  void drawLevel(int display, uint8_t level);
   Adafruit_NeoPixel *neopixel;
   Adafruit_NeoPixel *strip;
-  unsigned long ticktock;
+  unsigned long frameMillis;
+  uint8_t frameCount;
   int neopixelStatus;
   int neopixelFlash;
-  int neopixelCurrentStatus;
+  uint32_t neopixelShown;
+  indicator_track tracks[NUM_TRACKS];
+  indicator_keyframe blinkFrames[4];
+  indicator_keyframe fadeFrames[2][2];
+  uint8_t levelTarget[2];
+  uint32_t stripFrame[INDICATOR_STRIP_PIXELS];
+  bool stripDirty;
 };
 
 extern NeoPixelIndicator indicator;
@@ -25,28 +25,157 @@
 #ifndef SRC_INTTIMER_H_
 #define SRC_INTTIMER_H_
 
+#include <Arduino.h>
 #include <nrf_timer.h>
 
-typedef void (*funcPtr_t)(void*);
+// Hardware timer with the instance chosen at compile time. Each compare
+// channel has its own handler, given as a template argument so that the
+// IRQ handler calls it directly and it can be inlined. Periodic and
+// one-shot modes use the COMPARE->CLEAR and COMPARE->STOP shortcuts, so
+// the period does not depend on interrupt latency.
+//
+// Timer 0 is used by the soft device. Timers 1 and 2 have 4 compare
+// channels, timers 3 and 4 have 6. The IRQ handler is declared with
+//
+//   typedef InterruptTimer<2, on_compare0> MyTimer;
+//   INTTIMER_IRQ_HANDLER(2, MyTimer)
+
+#define INTTIMER_PRIORITY       5
+#define INTTIMER_MAX_CHANNELS   6
+
+typedef void (*inttimer_handler_t)(void);
+
+template <int N> struct InterruptTimerHW;
 
-class TimerClass {
+template <> struct InterruptTimerHW<1> {
+  static NRF_TIMER_Type* regs(void) { return NRF_TIMER1; }
+  static const IRQn_Type irq = TIMER1_IRQn;
+  static const int channels = 4;
+};
+
+template <> struct InterruptTimerHW<2> {
+  static NRF_TIMER_Type* regs(void) { return NRF_TIMER2; }
+  static const IRQn_Type irq = TIMER2_IRQn;
+  static const int channels = 4;
+};
+
+template <> struct InterruptTimerHW<3> {
+  static NRF_TIMER_Type* regs(void) { return NRF_TIMER3; }
+  static const IRQn_Type irq = TIMER3_IRQn;
+  static const int channels = 6;
+};
+
+template <> struct InterruptTimerHW<4> {
+  static NRF_TIMER_Type* regs(void) { return NRF_TIMER4; }
+  static const IRQn_Type irq = TIMER4_IRQn;
+  static const int channels = 6;
+};
+
+template <int N,
+          inttimer_handler_t CC0 = nullptr, inttimer_handler_t CC1 = nullptr,
+          inttimer_handler_t CC2 = nullptr, inttimer_handler_t CC3 = nullptr,
+          inttimer_handler_t CC4 = nullptr, inttimer_handler_t CC5 = nullptr>
+class InterruptTimer {
  public:
-  explicit TimerClass(int timer = 1);
-  void init(int microsecs);
-  void setCallback(funcPtr_t callback, void* ptr = NULL);
-  void start(void);
-  static void trigger(TimerClass* ctx) {
-    if (ctx) ctx->process();
+  typedef InterruptTimerHW<N> HW;
+  static_assert(((CC4 == nullptr) && (CC5 == nullptr)) || (HW::channels > 4),
+                "Timer has only 4 compare channels");
+
+  static void begin(nrf_timer_frequency_t freq = NRF_TIMER_FREQ_16MHz,
+                    uint8_t priority = INTTIMER_PRIORITY) {
+    NRF_TIMER_Type *t = HW::regs();
+    nrf_timer_task_trigger(t, NRF_TIMER_TASK_STOP);
+    nrf_timer_task_trigger(t, NRF_TIMER_TASK_CLEAR);
+    nrf_timer_mode_set(t, NRF_TIMER_MODE_TIMER);
+    nrf_timer_bit_width_set(t, NRF_TIMER_BIT_WIDTH_32);
+    nrf_timer_frequency_set(t, freq);
+    nrf_timer_shorts_disable(t, 0xFFFFFFFF);
+    nrf_timer_int_disable(t, 0xFFFFFFFF);
+    frequency() = freq;
+
+    NVIC_SetPriority(HW::irq, priority);
+    NVIC_ClearPendingIRQ(HW::irq);
+    NVIC_EnableIRQ(HW::irq);
+  }
+
+  static void setPeriodic(int channel, uint32_t us) {
+    // Counter is cleared in hardware on the compare
+    setCompare(channel, us);
+    nrf_timer_shorts_enable(HW::regs(),
+      NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK << channel);
+  }
+
+  static void setOneShot(int channel, uint32_t us) {
+    // Timer stops (and clears) on the compare, start() to run again
+    setCompare(channel, us);
+    nrf_timer_shorts_enable(HW::regs(),
+      (NRF_TIMER_SHORT_COMPARE0_STOP_MASK
+       | NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK) << channel);
   }
+
+  static void setCompare(int channel, uint32_t us) {
+    // Compare against the free running counter, no shortcuts
+    NRF_TIMER_Type *t = HW::regs();
+    nrf_timer_cc_write(t, static_cast<nrf_timer_cc_channel_t>(channel),
+      nrf_timer_us_to_ticks(us, frequency()));
+    nrf_timer_event_clear(t, nrf_timer_compare_event_get(channel));
+    nrf_timer_int_enable(t, NRF_TIMER_INT_COMPARE0_MASK << channel);
+  }
+
+  static void disable(int channel) {
+    NRF_TIMER_Type *t = HW::regs();
+    nrf_timer_int_disable(t, NRF_TIMER_INT_COMPARE0_MASK << channel);
+    nrf_timer_shorts_disable(t,
+      (NRF_TIMER_SHORT_COMPARE0_STOP_MASK
+       | NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK) << channel);
+  }
+
+  static void start(void) {
+    nrf_timer_task_trigger(HW::regs(), NRF_TIMER_TASK_START);
+  }
+
+  static void stop(void) {
+    nrf_timer_task_trigger(HW::regs(), NRF_TIMER_TASK_STOP);
+  }
+
+  static void clear(void) {
+    nrf_timer_task_trigger(HW::regs(), NRF_TIMER_TASK_CLEAR);
+  }
+
+  static inline __attribute__((always_inline)) void dispatch(void) {
+    // Called from the IRQ handler, unused channels compile away
+    service<0, CC0>();
+    service<1, CC1>();
+    service<2, CC2>();
+    service<3, CC3>();
+    service<4, CC4>();
+    service<5, CC5>();
+  }
+
  private:
-  void process(void);
-  void setNVIC(IRQn_Type IRQn);
-  NRF_TIMER_Type*        nrf_timer;
-  funcPtr_t callback_ptr;
-  void *usrptr;
+  static nrf_timer_frequency_t& frequency(void) {
+    static nrf_timer_frequency_t freq = NRF_TIMER_FREQ_16MHz;
+    return freq;
+  }
+
+  template <int C, inttimer_handler_t H>
+  static inline __attribute__((always_inline)) void service(void) {
+    if (H == nullptr) {
+      return;
+    }
+
+    NRF_TIMER_Type *t = HW::regs();
+    nrf_timer_event_t event = nrf_timer_compare_event_get(C);
+    if (nrf_timer_event_check(t, event)) {
+      nrf_timer_event_clear(t, event);
+      H();
+    }
+  }
 };
 
-extern NRF_TIMER_Type* nrf_timers[5];
-extern TimerClass* Timers[5];
+#define INTTIMER_IRQ_HANDLER(n, timer) \
+  extern "C" void TIMER##n##_IRQHandler(void) { \
+    timer::dispatch(); \
+  }
 
 #endif  // SRC_INTTIMER_H_
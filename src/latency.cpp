@@ -0,0 +1,97 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "hal.h"
+#include "debug.h"
+#include "config.h"
+#include "latency.h"
+
+// LATENCY_CONTROL is written from loop(), the others only from
+// the triac timer interrupt.
+
+histogram latency_stages[LATENCY_NUM_STAGES];
+volatile unsigned long latency_misses = 0;
+unsigned long latency_print_millis = 0;
+
+static const char* const latency_names[LATENCY_NUM_STAGES] = {
+  "control", "fire", "total"
+};
+
+void latency_control(unsigned long stamp, unsigned long now) {
+  histogram_record(&latency_stages[LATENCY_CONTROL], now - stamp);
+}
+
+void latency_fire(unsigned long stamp, unsigned long set,
+                  unsigned long now) {
+  histogram_record(&latency_stages[LATENCY_FIRE], now - set);
+  if (stamp) {
+    uint32_t total = now - stamp;
+    histogram_record(&latency_stages[LATENCY_TOTAL], total);
+    uint16_t slo = config_get()->latency_slo;
+    if (slo && (total > (slo * 1000UL))) {
+      latency_misses++;
+    }
+  }
+}
+
+const histogram* latency_get(int stage) {
+  if ((stage < 0) || (stage >= LATENCY_NUM_STAGES)) {
+    return NULL;
+  }
+
+  return &latency_stages[stage];
+}
+
+void latency_reset(void) {
+  for (int i = 0; i < LATENCY_NUM_STAGES; i++) {
+    histogram_reset(&latency_stages[i]);
+  }
+  latency_misses = 0;
+}
+
+unsigned long latency_slo_misses(void) {
+  return latency_misses;
+}
+
+void latency_loop(void) {
+  if ((hal_millis() - latency_print_millis) < LATENCY_PRINT_PERIOD) {
+    return;
+  }
+  latency_print_millis = hal_millis();
+
+  for (int i = 0; i < LATENCY_NUM_STAGES; i++) {
+    const histogram *h = &latency_stages[i];
+    if (!h->count) {
+      continue;
+    }
+
+    LOG_INFO("Latency %s : count = %lu min = %lu max = %lu mean = %lu us\n",
+      latency_names[i], h->count, h->min, h->max, histogram_mean(h));
+  }
+
+  uint16_t slo = config_get()->latency_slo;
+  if (slo) {
+    LOG_INFO("Latency SLO %d ms missed %lu times\n", slo, latency_misses);
+  }
+}
@@ -0,0 +1,49 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_LATENCY_H_
+#define SRC_LATENCY_H_
+
+#include <stdint.h>
+#include "histogram.h"
+
+// Latency from a sensor sample arriving to the fan output changing.
+// Each sample carries its arrival time (micros) through the control
+// loop to triac_set_output(), and the triac timer records when the new
+// delay first fires. All times are in us.
+
+#define LATENCY_CONTROL         0     // Arrival to triac_set_output()
+#define LATENCY_FIRE            1     // triac_set_output() to firing
+#define LATENCY_TOTAL           2     // Arrival to firing
+#define LATENCY_NUM_STAGES      3
+#define LATENCY_PRINT_PERIOD    30000
+
+void latency_control(unsigned long stamp, unsigned long now);
+void latency_fire(unsigned long stamp, unsigned long set, unsigned long now);
+const histogram* latency_get(int stage);
+void latency_reset(void);
+unsigned long latency_slo_misses(void);
+void latency_loop(void);
+
+#endif  // SRC_LATENCY_H_
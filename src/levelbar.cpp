@@ -0,0 +1,96 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "colormap.h"
+#include "indicator.h"
+#include "levelbar.h"
+
+// Tables generated at compile time, see colormap.h
+
+static constexpr colormap_table<colormap_hot> cmap_hot;
+static constexpr colormap_table<colormap_viridis> cmap_viridis;
+static constexpr colormap_table<colormap_custom> cmap_custom;
+
+struct level_table {
+  // For each level the number of full pixels in a bar and the gamma
+  // corrected brightness of the next one
+  uint8_t full[256];
+  uint8_t scale[256];
+
+  constexpr level_table() : full(), scale() {
+    for (int i = 0; i < 256; i++) {
+      int pos = (i * INDICATOR_BAR_PIXELS * 256 + 127) / 255;
+      full[i] = pos >> 8;
+      scale[i] = cmap_gamma((pos & 0xFF) / 255.0f, COLORMAP_GAMMA);
+    }
+  }
+};
+
+static constexpr level_table level_split;
+
+// 4 bit ordered dither thresholds, one per frame
+static const uint8_t dither[16] = {
+  0, 128, 64, 192, 32, 160, 96, 224, 16, 144, 80, 208, 48, 176, 112, 240
+};
+
+uint32_t levelbar_color(uint8_t map, uint8_t level) {
+  switch (map) {
+    case COLORMAP_VIRIDIS:
+      return cmap_viridis[level];
+    case COLORMAP_CUSTOM:
+      return cmap_custom[level];
+    default:
+      return cmap_hot[level];
+  }
+}
+
+uint32_t levelbar_dim(uint32_t color, uint8_t scale, uint8_t frame) {
+  // Scale each channel in 8.8 fixed point. Dim channels are dithered
+  // over frames so the fraction lost to 8 bits still shows on average.
+  if (!scale) {
+    return 0;
+  }
+
+  uint32_t out = 0;
+  for (int shift = 0; shift < 24; shift += 8) {
+    uint32_t v = ((color >> shift) & 0xFF) * (scale + 1);
+    if ((v >> 8) < INDICATOR_DITHER_MAX) {
+      v += dither[frame & 0x0F];
+    }
+    out |= (v >> 8) << shift;
+  }
+
+  return out;
+}
+
+void levelbar_draw(uint32_t *bar, uint8_t map, uint8_t level, uint8_t frame) {
+  // Pixels from the bottom of the bar up
+  uint32_t color = levelbar_color(map, level);
+  int full = level_split.full[level];
+  uint32_t top = levelbar_dim(color, level_split.scale[level], frame);
+
+  for (int i = 0; i < INDICATOR_BAR_PIXELS; i++) {
+    bar[i] = (i < full) ? color : ((i == full) ? top : 0);
+  }
+}
@@ -0,0 +1,40 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_LEVELBAR_H_
+#define SRC_LEVELBAR_H_
+
+#include <stdint.h>
+#include "indicator.h"
+
+// Mapping of a 0 - 255 level to the pixels of one bar of the strip.
+// The bar is colored from the colormap at the level, with the top pixel
+// carrying the remainder so there are INDICATOR_BAR_PIXELS x 256 steps.
+// Kept apart from NeoPixelIndicator so it builds on the host as well.
+
+uint32_t levelbar_color(uint8_t map, uint8_t level);
+uint32_t levelbar_dim(uint32_t color, uint8_t scale, uint8_t frame);
+void levelbar_draw(uint32_t *bar, uint8_t map, uint8_t level, uint8_t frame);
+
+#endif  // SRC_LEVELBAR_H_
@@ -0,0 +1,195 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "hal.h"
+#include "logger.h"
+
+log_entry log_ring[LOG_ENTRIES];
+uint32_t log_head = 0;
+uint32_t log_tail = 0;
+uint32_t log_dropped = 0;
+uint32_t log_dropped_reported = 0;
+
+log_entry* log_reserve(void) {
+  // Claim the next slot, this may be called from any context
+  uint32_t head = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+  do {
+    uint32_t tail = __atomic_load_n(&log_tail, __ATOMIC_ACQUIRE);
+    if ((head - tail) >= LOG_ENTRIES) {
+      __atomic_add_fetch(&log_dropped, 1, __ATOMIC_RELAXED);
+      return NULL;
+    }
+  } while (!__atomic_compare_exchange_n(&log_head, &head, head + 1, true,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+  log_entry *entry = &log_ring[head & (LOG_ENTRIES - 1)];
+  entry->seq = head;  // Reserved but not yet committed
+  return entry;
+}
+
+void log_commit(log_entry *entry, uint32_t seq) {
+  __atomic_store_n(&entry->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+static int log_format_arg(char *out, int size, const char *spec, int spec_len,
+                          const log_entry *entry, int n) {
+  // Rebuild a single conversion with the right type for the argument
+  char conv = spec[spec_len - 1];
+  char fmt[16];
+  int len = 0;
+  for (int i = 0; (i < spec_len - 1) && (len < 12); i++) {
+    if ((spec[i] != 'l') && (spec[i] != 'h') && (spec[i] != 'z')) {
+      fmt[len++] = spec[i];
+    }
+  }
+
+  uint32_t val = entry->args[n];
+  int tag = (entry->tags >> (n * 2)) & 0x03;
+  switch (conv) {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+      fmt[len++] = 'l';
+      fmt[len++] = conv;
+      fmt[len] = 0;
+      if (tag == LOG_TAG_INT) {
+        return snprintf(out, size, fmt,
+          static_cast<long>(static_cast<int32_t>(val)));
+      }
+      return snprintf(out, size, fmt, static_cast<unsigned long>(val));
+    case 'c':
+      fmt[len++] = conv;
+      fmt[len] = 0;
+      return snprintf(out, size, fmt, static_cast<int>(val));
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G': {
+      fmt[len++] = conv;
+      fmt[len] = 0;
+      float f = 0;
+      if (tag == LOG_TAG_FLOAT) {
+        memcpy(&f, &val, sizeof(f));
+      }
+      return snprintf(out, size, fmt, static_cast<double>(f));
+    }
+    case 's':
+      fmt[len++] = conv;
+      fmt[len] = 0;
+      if ((tag == LOG_TAG_STR) && (val < LOG_STR_LEN)) {
+        return snprintf(out, size, fmt, &entry->str[val]);
+      }
+      return snprintf(out, size, "?");
+    default:
+      return snprintf(out, size, "?");
+  }
+}
+
+static int log_format(char *out, int size, const log_entry *entry) {
+  const log_site *site = entry->site;
+  int len = snprintf(out, size, "%s:%d:%s(): ",
+    site->file, site->line, site->func);
+
+  const char *p = site->fmt;
+  int n = 0;
+  while (*p && (len < (size - 1))) {
+    if (*p != '%') {
+      out[len++] = *p++;
+      continue;
+    }
+
+    if (p[1] == '%') {
+      out[len++] = '%';
+      p += 2;
+      continue;
+    }
+
+    // Find the end of the conversion
+    const char *spec = p++;
+    while (*p && !strchr("diuxXocfFeEgGsp", *p)) {
+      p++;
+    }
+    if (!*p) {
+      break;
+    }
+    p++;
+
+    if (n < entry->nargs) {
+      int r = log_format_arg(&out[len], size - len, spec, p - spec, entry, n);
+      if (r > 0) {
+        len += r;
+      }
+    }
+    n++;
+  }
+
+  if (len > (size - 1)) {
+    len = size - 1;
+  }
+  out[len] = 0;
+  return len;
+}
+
+void logger_loop(void) {
+  static char line[LOG_LINE_LEN];
+
+  if (!hal_console_ready()) {
+    return;
+  }
+
+  for (int i = 0; i < LOG_DRAIN_MAX; i++) {
+    uint32_t tail = log_tail;
+    log_entry *entry = &log_ring[tail & (LOG_ENTRIES - 1)];
+    if (__atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE) != (tail + 1)) {
+      break;
+    }
+
+    // Don't block if the host is not keeping up, try again later
+    int len = log_format(line, sizeof(line), entry);
+    if (hal_console_space() < len) {
+      break;
+    }
+    hal_console_write(line, len);
+
+    __atomic_store_n(&log_tail, tail + 1, __ATOMIC_RELEASE);
+  }
+
+  uint32_t dropped = __atomic_load_n(&log_dropped, __ATOMIC_RELAXED);
+  if ((dropped != log_dropped_reported)
+      && (hal_console_space() >= 32)) {
+    int len = snprintf(line, sizeof(line), "Log dropped %lu entries\n",
+      static_cast<unsigned long>(dropped - log_dropped_reported));
+    hal_console_write(line, len);
+    log_dropped_reported = dropped;
+  }
+}
+
+unsigned long logger_dropped(void) {
+  return log_dropped;
+}
@@ -0,0 +1,180 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_LOGGER_H_
+#define SRC_LOGGER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hal.h"
+
+// Deferred logging. Each call writes a pointer to a static description
+// of the call site (which lives in flash and acts as the message id)
+// and the raw arguments into a lock-free ring. The formatting and
+// output to Serial is done later by logger_loop() from loop(). This is
+// safe to call from interrupts.
+
+#define LOG_LEVEL_NONE          0
+#define LOG_LEVEL_ERROR         1
+#define LOG_LEVEL_WARN          2
+#define LOG_LEVEL_INFO          3
+#define LOG_LEVEL_DEBUG         4
+
+#ifndef LOG_LEVEL
+  #ifdef DEBUG_OUTPUT
+    #define LOG_LEVEL           LOG_LEVEL_DEBUG
+  #else
+    #define LOG_LEVEL           LOG_LEVEL_NONE
+  #endif
+#endif
+
+#define LOG_ENTRIES             64    // Must be a power of 2
+#define LOG_MAX_ARGS            8
+#define LOG_STR_LEN             20    // Space for copies of string args
+#define LOG_LINE_LEN            160
+#define LOG_DRAIN_MAX           8     // Entries output per logger_loop()
+
+#define LOG_TAG_INT             0
+#define LOG_TAG_UINT            1
+#define LOG_TAG_FLOAT           2
+#define LOG_TAG_STR             3
+
+typedef struct {
+  const char *file;
+  const char *func;
+  const char *fmt;
+  uint16_t line;
+  uint8_t level;
+} log_site;
+
+typedef struct {
+  uint32_t seq;
+  const log_site *site;
+  uint32_t time;
+  uint16_t tags;
+  uint8_t nargs;
+  uint8_t str_len;
+  uint32_t args[LOG_MAX_ARGS];
+  char str[LOG_STR_LEN];
+} log_entry;
+
+log_entry* log_reserve(void);
+void log_commit(log_entry *entry, uint32_t seq);
+void logger_loop(void);
+unsigned long logger_dropped(void);
+
+static inline void log_put(log_entry *e, int n, uint8_t tag, uint32_t val) {
+  e->args[n] = val;
+  e->tags |= tag << (n * 2);
+}
+
+static inline void log_put(log_entry *e, int n, int val) {
+  log_put(e, n, LOG_TAG_INT, static_cast<uint32_t>(val));
+}
+
+static inline void log_put(log_entry *e, int n, long val) {
+  log_put(e, n, LOG_TAG_INT, static_cast<uint32_t>(val));
+}
+
+static inline void log_put(log_entry *e, int n, long long val) {
+  log_put(e, n, LOG_TAG_INT, static_cast<uint32_t>(val));
+}
+
+static inline void log_put(log_entry *e, int n, unsigned int val) {
+  log_put(e, n, LOG_TAG_UINT, static_cast<uint32_t>(val));
+}
+
+static inline void log_put(log_entry *e, int n, unsigned long val) {
+  log_put(e, n, LOG_TAG_UINT, static_cast<uint32_t>(val));
+}
+
+static inline void log_put(log_entry *e, int n, unsigned long long val) {
+  log_put(e, n, LOG_TAG_UINT, static_cast<uint32_t>(val));
+}
+
+static inline void log_put(log_entry *e, int n, double val) {
+  float f = val;
+  uint32_t raw;
+  __builtin_memcpy(&raw, &f, sizeof(raw));
+  log_put(e, n, LOG_TAG_FLOAT, raw);
+}
+
+static inline void log_put(log_entry *e, int n, const char *val) {
+  // Strings may be on the stack so keep a copy
+  uint32_t offset = e->str_len;
+  if (!val) {
+    val = "(null)";
+  }
+  while (*val && (e->str_len < (LOG_STR_LEN - 1))) {
+    e->str[e->str_len++] = *val++;
+  }
+  if (e->str_len < LOG_STR_LEN) {
+    e->str[e->str_len++] = 0;
+  }
+  log_put(e, n, LOG_TAG_STR, offset);
+}
+
+static inline void log_pack(log_entry *e, int n) {
+  e->nargs = n;
+}
+
+template<typename T, typename... Args>
+inline void log_pack(log_entry *e, int n, T val, Args... args) {
+  log_put(e, n, val);
+  log_pack(e, n + 1, args...);
+}
+
+template<typename... Args>
+inline void log_write(const log_site *site, uint32_t time, Args... args) {
+  static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "Too many log arguments");
+
+  log_entry *e = log_reserve();
+  if (!e) {
+    return;
+  }
+
+  uint32_t seq = e->seq;
+  e->site = site;
+  e->time = time;
+  e->tags = 0;
+  e->str_len = 0;
+  log_pack(e, 0, args...);
+  log_commit(e, seq);
+}
+
+#define LOG_MSG(level, fmt, ...) \
+  do { \
+    if ((level) <= LOG_LEVEL) { \
+      static const log_site _log_site = \
+        {__FILE__, __func__, fmt, __LINE__, level}; \
+      log_write(&_log_site, hal_millis(), ##__VA_ARGS__); \
+    } \
+  } while (0)
+
+#define LOG_ERROR(fmt, ...)     LOG_MSG(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#define LOG_WARN(fmt, ...)      LOG_MSG(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define LOG_INFO(fmt, ...)      LOG_MSG(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(fmt, ...)     LOG_MSG(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+
+#endif  // SRC_LOGGER_H_
@@ -28,21 +28,22 @@
 
 #include "wiring.h"
 #include "debug.h"
+#include "logger.h"
 #include "triac.h"
-#include "inttimer.h"
 #include "bluetooth.h"
 #include "uart_cmd.h"
 #include "indicator.h"
 #include "file.h"
 #include "config.h"
-
-// Global variables
-
-config_data config;
-
-void bluetooth_rx_callback(const char* cmd, int cmd_len, void* ctx) {
-  DEBUG_PRINT("Recieved data [%s]\n", cmd);
-}
+#include "control.h"
+#include "telemetry.h"
+#include "sensor.h"
+#include "broadcast.h"
+#include "profile.h"
+#include "latency.h"
+#include "ridelog.h"
+#include "button.h"
+#include "bench.h"
 
 void setup() {
   // Setup Input / Output
@@ -60,6 +61,7 @@ void setup() {
 
   indicator.begin();
   indicator.setStatus(NeoPixelIndicator::BOOT);
+  indicator.render();
 
   // Flash drive must be setup before Serial Monitor
   file_setup();
@@ -74,25 +76,39 @@ void setup() {
 
   DEBUG_COMMENT("Started FanSpeedController.\n");
 
+#ifdef BENCHMARK
+  // Benchmark build (env:bench), the results go to the serial monitor
+  bench_run();
+  return;
+#endif
+
   // Setup watchdog
 
   int countdownMS = Watchdog.enable(WATCHDOG_TIMEOUT);
   DEBUG_PRINT("Enabled watchdog with max countdown of %d\n", countdownMS);
 
+  // Load the last config, settings.json is parsed later if changed
+  file_load_snapshot();
+
+  profile_setup();
+
   // Setup TRIACs
 
   triac_setup();
   Watchdog.reset();
 
+  // Start the NeoPixel sweep, drawn from a timer while bluetooth is set
+  // up and then from loop()
+
+  indicator.startupEffect();
+  indicator.renderInBackground(true);
+
   // Setup Bluetooth
   DEBUG_COMMENT("Setting up bluetooth.\n");
   bluetooth_setup();
-  bluetooth_set_rx_callback(bluetooth_rx_callback, NULL);
-  Watchdog.reset();
-
-  // Setup NeoPixel Indicators
-
-  indicator.startupEffect();
+  uart_cmd_setup();
+  button_setup();
+  indicator.renderInBackground(false);
   indicator.setStatus(NeoPixelIndicator::OK, 10);
   Watchdog.reset();
 
@@ -103,53 +119,68 @@ void setup() {
 }
 
 void loop() {
-  static unsigned long off_timer = 0;
   static unsigned long last_loop_millis = 0;
-  static uint8_t op = 0;
+  static uint32_t last_generation = config_get_live()->generation;
+  static uint32_t last_select = config_select_generation();
+
+#ifdef BENCHMARK
+  return;
+#endif
+
+  PROFILE_START();
 
   Watchdog.reset();  // Pet the dog!
 
+  logger_loop();
+  profile_loop();
+  latency_loop();
+
+  bluetooth_loop();
+  uart_cmd_loop();
+  telemetry_loop();
+  broadcast_loop();
+  ridelog_loop();
+
+  if (button_pressed()) {
+    // Step through the stored profiles
+    config_profile_select((config_profile_get() + 1) % config_profile_count());
+  }
+
+  uint32_t generation = config_get_live()->generation;
+  if ((generation != last_generation)
+      || (config_select_generation() != last_select)) {
+    // New config or profile, apply it straight away
+    last_generation = generation;
+    last_select = config_select_generation();
+    bluetooth_update_config();
+    float speed = sensor_get_speed();
+    control_update(speed, sensor_get_stamp());
+  }
+
+  sensor_loop();
+  if (sensor_virtual_pending()) {
+    // Apply app driven speed as soon as it arrives
+    float speed = sensor_get_speed();
+    control_update(speed, sensor_get_stamp());
+  }
+
   if (bluetooth_get_connections()) {
     // We have active connections
-    indicator.setStatus(NeoPixelIndicator::BT_CONNECTED, 10);
+    indicator.setStatus(NeoPixelIndicator::BT_CONNECTED, INDICATOR_PULSE);
   } else {
     indicator.setStatus(NeoPixelIndicator::OK, 0);
   }
+  indicator.render();
 
   if ((millis() - last_loop_millis) > 3000) {
-    // First check for new settings
+    // First check for new settings, applied above on the next loop
     file_loop();
 
-    float speed = bluetooth_calculate_speed();
-    if (speed >= config.speed_max) {
-      op = 255;
-      off_timer = millis();  // Reset each cycle
-    } else if ((speed >= config.speed_min) && (speed < config.speed_max)) {
-      op = static_cast<uint8_t>(255 * (
-          (speed - config.speed_min) / config.speed_max));
-      off_timer = millis();  // Reset each cycle
-    } else if (speed >= config.speed_threshold) {
-      op = 1;
-      off_timer = millis();  // Reset each cycle
-    }
-
-    // Check for off timer
-
-    DEBUG_PRINT("off_timer = %ld\n", off_timer);
-    if (((millis() - off_timer) > 30000L) && (speed < 1.5)) {
-      DEBUG_PRINT("off_timer countdown = %ld\n", millis() - off_timer);
-      op = 0;
-    }
-
-    // Set indicators
+    float speed = sensor_get_speed();
+    control_update(speed, sensor_get_stamp());
 
-    indicator.setLevel(0, op);
-    indicator.setLevel(1, op);
-
-    // Set the fan output
-    triac_set_output(op, op);
-
-    DEBUG_PRINT("Mains Frequency          = %f\n", calc_mains_freq());
+    calc_mains_freq();
+    DEBUG_PRINT("Mains Frequency          = %f\n", get_mains_freq());
     DEBUG_PRINT("Hardtimer count          = %ld\n", hardtimer_count);
     DEBUG_PRINT("Zerocross pulse positive = %ld\n", zero_cross_pulse1);
     DEBUG_PRINT("Zerocross pulse negative = %ld\n", zero_cross_pulse2);
@@ -158,4 +189,6 @@ void loop() {
 
     last_loop_millis = millis();
   }
+
+  PROFILE_END(PROFILE_LOOP);
 }
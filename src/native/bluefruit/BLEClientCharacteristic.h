@@ -0,0 +1,74 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_NATIVE_BLUEFRUIT_BLECLIENTCHARACTERISTIC_H_
+#define SRC_NATIVE_BLUEFRUIT_BLECLIENTCHARACTERISTIC_H_
+
+#include "bluefruit_common.h"
+
+class BLEClientService;
+
+class BLEClientCharacteristic {
+ public:
+  typedef void (*notify_cb_t)(BLEClientCharacteristic* chr,
+                              uint8_t* data, uint16_t len);
+
+  explicit BLEClientCharacteristic(uint16_t uuid)
+    : uuid(uuid), _notify_cb(NULL), _service(NULL) {
+  }
+  virtual ~BLEClientCharacteristic(void) {
+  }
+
+  void setNotifyCallback(notify_cb_t fp, bool useAdaCallback = true) {
+    (void) useAdaCallback;
+    _notify_cb = fp;
+  }
+  void begin(BLEClientService *parent = NULL) {
+    _service = parent;
+  }
+  uint8_t read8(void) {
+    return 0;
+  }
+  bool enableNotify(void) {
+    return true;
+  }
+  bool disableNotify(void) {
+    return true;
+  }
+
+  // Host only, as a notification from the peer
+  void notify(uint8_t *data, uint16_t len) {
+    if (_notify_cb) {
+      _notify_cb(this, data, len);
+    }
+  }
+
+  uint16_t uuid;
+
+ private:
+  notify_cb_t _notify_cb;
+  BLEClientService *_service;
+};
+
+#endif  // SRC_NATIVE_BLUEFRUIT_BLECLIENTCHARACTERISTIC_H_
@@ -0,0 +1,58 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_NATIVE_BLUEFRUIT_BLECLIENTSERVICE_H_
+#define SRC_NATIVE_BLUEFRUIT_BLECLIENTSERVICE_H_
+
+#include "bluefruit_common.h"
+
+class BLEClientService {
+ public:
+  explicit BLEClientService(uint16_t uuid)
+    : uuid(uuid), _conn_hdl(BLE_CONN_HANDLE_INVALID) {
+  }
+  virtual ~BLEClientService(void) {
+  }
+
+  virtual bool begin(void) {
+    return true;
+  }
+  virtual bool discover(uint16_t conn_handle) {
+    _conn_hdl = conn_handle;
+    return true;
+  }
+  bool discovered(void) {
+    return _conn_hdl != BLE_CONN_HANDLE_INVALID;
+  }
+  uint16_t connHandle(void) {
+    return _conn_hdl;
+  }
+
+  uint16_t uuid;
+
+ protected:
+  uint16_t _conn_hdl;
+};
+
+#endif  // SRC_NATIVE_BLUEFRUIT_BLECLIENTSERVICE_H_
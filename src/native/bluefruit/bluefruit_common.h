@@ -0,0 +1,49 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_NATIVE_BLUEFRUIT_BLUEFRUIT_COMMON_H_
+#define SRC_NATIVE_BLUEFRUIT_BLUEFRUIT_COMMON_H_
+
+// Host stand in for the parts of the Bluefruit library used by
+// BLEClient.cpp, so the sensor parsers build in env:native unchanged.
+// There is no radio, notifications are delivered with notify().
+
+#include <stdint.h>
+#include "hal.h"
+
+#define UUID16_SVC_CYCLING_SPEED_AND_CADENCE    0x1816
+#define UUID16_SVC_CYCLING_POWER                0x1818
+#define UUID16_CHR_CSC_MEASUREMENT              0x2A5B
+#define UUID16_CHR_CYCLING_POWER_MEASUREMENT    0x2A63
+
+#define BLE_CONN_HANDLE_INVALID                 0xFFFF
+
+#define VERIFY(condition) \
+  do { \
+    if (!(condition)) { \
+      return false; \
+    } \
+  } while (0)
+
+#endif  // SRC_NATIVE_BLUEFRUIT_BLUEFRUIT_COMMON_H_
@@ -0,0 +1,209 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "bluefruit.h"
+#include "hal.h"
+#include "BLEClient.h"
+#include "bluetooth.h"
+#include "ridelog.h"
+#include "native/bluetooth_native.h"
+
+typedef struct {
+  uint8_t buf[BT_NATIVE_UART_SIZE];
+  uint32_t head;
+  uint32_t tail;
+} bt_native_ring;
+
+AdafruitBluefruit Bluefruit;
+BLEClientSandC bt_native_sandc;
+BLEClientPower bt_native_power_svc;
+bool bt_native_parsed = false;        // Samples come through BLEClient
+
+bool bt_native_sensor = false;
+bool bt_native_uart = false;
+float bt_native_speed = 0;
+int bt_native_power = 0;
+unsigned long bt_native_millis = 0;
+unsigned long bt_native_micros = 0;
+bt_native_ring bt_native_rx;
+bt_native_ring bt_native_tx;
+uint8_t bt_native_msd[31];
+int bt_native_msd_len = 0;
+bluetoothFuncPtr_t bt_native_rx_callback = NULL;
+void* bt_native_rx_callback_ptr = NULL;
+
+static int bt_native_put(bt_native_ring *ring, const uint8_t *buf, int len) {
+  int n = 0;
+  while ((n < len) && ((ring->head - ring->tail) < BT_NATIVE_UART_SIZE)) {
+    ring->buf[ring->head++ & (BT_NATIVE_UART_SIZE - 1)] = buf[n++];
+  }
+  return n;
+}
+
+static int bt_native_get(bt_native_ring *ring, uint8_t *buf, int len) {
+  int n = 0;
+  while ((n < len) && (ring->head != ring->tail)) {
+    buf[n++] = ring->buf[ring->tail++ & (BT_NATIVE_UART_SIZE - 1)];
+  }
+  return n;
+}
+
+void bluetooth_setup(void) {
+}
+
+void bluetooth_loop(void) {
+}
+
+void bluetooth_update_config(void) {
+}
+
+void bluetooth_advertising_start(const uint8_t *msd, int msd_len) {
+  if (msd_len > static_cast<int>(sizeof(bt_native_msd))) {
+    msd_len = sizeof(bt_native_msd);
+  }
+  memcpy(bt_native_msd, msd, msd_len);
+  bt_native_msd_len = msd_len;
+}
+
+void bluetooth_set_rx_callback(bluetoothFuncPtr_t func, void* ctx) {
+  bt_native_rx_callback = func;
+  bt_native_rx_callback_ptr = ctx;
+}
+
+int bluetooth_uart_read(uint8_t *buf, int len) {
+  return bt_native_get(&bt_native_rx, buf, len);
+}
+
+int bluetooth_uart_write(const uint8_t *buf, int len) {
+  return bt_native_put(&bt_native_tx, buf, len);
+}
+
+bool bluetooth_uart_connected(void) {
+  return bt_native_uart;
+}
+
+int bluetooth_uart_mtu(void) {
+  return BT_UART_MTU - 3;
+}
+
+float bluetooth_calculate_speed(void) {
+  if (bt_native_parsed) {
+    return bt_native_sandc.getSandC()->calculate();
+  }
+  return bt_native_speed;
+}
+
+float bluetooth_calculate_cadence(void) {
+  if (bt_native_parsed) {
+    return bt_native_sandc.getSandC()->calculateCadence();
+  }
+  return 0.0;
+}
+
+bool bluetooth_speed_valid(void) {
+  unsigned long last = bt_native_millis;
+  if (bt_native_parsed) {
+    last = bt_native_sandc.getSandC()->getLastUpdate();
+  }
+  return bt_native_sensor && last
+    && ((hal_millis() - last) < SENSOR_TIMEOUT);
+}
+
+unsigned long bluetooth_speed_stamp(void) {
+  if (bt_native_parsed) {
+    return bt_native_sandc.getSandC()->getLastUpdateMicros();
+  }
+  return bt_native_micros;
+}
+
+int bluetooth_get_power(void) {
+  if (!bt_native_sensor) {
+    return 0;
+  }
+  if (bt_native_parsed) {
+    return bt_native_power_svc.getPower()->getInstPower();
+  }
+  return bt_native_power;
+}
+
+int bluetooth_get_connections(void) {
+  return bt_native_sensor ? 0x03 : 0;
+}
+
+void bluetooth_native_reset(void) {
+  bt_native_sensor = false;
+  bt_native_uart = false;
+  bt_native_speed = 0;
+  bt_native_power = 0;
+  bt_native_millis = 0;
+  bt_native_micros = 0;
+  bt_native_rx.head = bt_native_rx.tail = 0;
+  bt_native_tx.head = bt_native_tx.tail = 0;
+  bt_native_msd_len = 0;
+}
+
+void bluetooth_native_sensor(float speed, int power) {
+  // As a notification from the speed and power sensors
+  bt_native_speed = speed;
+  bt_native_power = power;
+  bt_native_millis = hal_millis();
+  bt_native_micros = hal_micros();
+}
+
+void bluetooth_native_notify(uint8_t type, uint8_t *data, uint16_t len) {
+  // Through the notify callbacks, as from the soft device
+  if (!bt_native_parsed) {
+    bt_native_sandc.begin();
+    bt_native_power_svc.begin();
+    bt_native_parsed = true;
+  }
+
+  if (type == RIDELOG_TRACE_CSC) {
+    bt_native_sandc.getSandC()->notify(data, len);
+  } else if (type == RIDELOG_TRACE_CPS) {
+    bt_native_power_svc.getPower()->notify(data, len);
+  }
+}
+
+void bluetooth_native_set_connected(bool sensor, bool uart) {
+  bt_native_sensor = sensor;
+  bt_native_uart = uart;
+}
+
+int bluetooth_native_uart_rx(const uint8_t *buf, int len) {
+  int n = bt_native_put(&bt_native_rx, buf, len);
+  if (n && bt_native_rx_callback) {
+    bt_native_rx_callback(0, bt_native_rx_callback_ptr);
+  }
+  return n;
+}
+
+int bluetooth_native_uart_tx(uint8_t *buf, int len) {
+  return bt_native_get(&bt_native_tx, buf, len);
+}
+
+int bluetooth_native_advertising(const uint8_t **msd) {
+  *msd = bt_native_msd;
+  return bt_native_msd_len;
+}
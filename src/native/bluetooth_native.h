@@ -0,0 +1,48 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_NATIVE_BLUETOOTH_NATIVE_H_
+#define SRC_NATIVE_BLUETOOTH_NATIVE_H_
+
+#include <stdint.h>
+
+// Host side of the fake bluetooth.h. Sensor samples and UART data come
+// from the host program instead of the radio, and everything written to
+// the UART or advertised is kept for it to read back.
+//
+// Samples are either a speed and power set directly, or raw speed /
+// cadence and power notifications which go through the parsers in
+// BLEClient.cpp as on the device.
+
+#define BT_NATIVE_UART_SIZE     1024  // Must be a power of 2
+
+void bluetooth_native_reset(void);
+void bluetooth_native_sensor(float speed, int power);
+void bluetooth_native_notify(uint8_t type, uint8_t *data, uint16_t len);
+void bluetooth_native_set_connected(bool sensor, bool uart);
+int bluetooth_native_uart_rx(const uint8_t *buf, int len);
+int bluetooth_native_uart_tx(uint8_t *buf, int len);
+int bluetooth_native_advertising(const uint8_t **msd);
+
+#endif  // SRC_NATIVE_BLUETOOTH_NATIVE_H_
@@ -0,0 +1,72 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "hal.h"
+#include "debug.h"
+#include "config.h"
+#include "control.h"
+#include "triac.h"
+#include "sensor.h"
+#include "uart_cmd.h"
+#include "telemetry.h"
+#include "broadcast.h"
+#include "latency.h"
+#include "profile.h"
+#include "native/bluetooth_native.h"
+#include "native/firmware.h"
+
+unsigned long firmware_control_millis = 0;
+
+void firmware_setup(void) {
+  hal_native_reset();
+  bluetooth_native_reset();
+
+  config_set_defaults();
+  profile_setup();
+  triac_setup();
+  uart_cmd_setup();
+  firmware_control_millis = 0;
+}
+
+void firmware_loop(void) {
+  logger_loop();
+  profile_loop();
+  latency_loop();
+  uart_cmd_loop();
+  telemetry_loop();
+  broadcast_loop();
+
+  sensor_loop();
+  if (sensor_virtual_pending()) {
+    float speed = sensor_get_speed();
+    control_update(speed, sensor_get_stamp());
+  }
+
+  if ((hal_millis() - firmware_control_millis) > FIRMWARE_CONTROL_PERIOD) {
+    float speed = sensor_get_speed();
+    control_update(speed, sensor_get_stamp());
+    calc_mains_freq();
+    firmware_control_millis = hal_millis();
+  }
+}
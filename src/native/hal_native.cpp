@@ -0,0 +1,287 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "hal.h"
+
+#define HAL_TIMER_WRAP          (1ULL << 32)
+
+typedef struct {
+  hal_timer_fire_t fire;
+  bool running;
+  uint64_t base;                        // Time the counter was zero
+  uint64_t counter;                     // Counter while stopped
+  uint32_t cc[HAL_NATIVE_CHANNELS];
+  uint8_t mode[HAL_NATIVE_CHANNELS];
+  uint64_t next[HAL_NATIVE_CHANNELS];   // Time of the next compare
+} hal_timer;
+
+uint64_t hal_now = 0;
+bool hal_pins[HAL_NATIVE_PINS];
+hal_isr_t hal_isrs[HAL_NATIVE_PINS];
+hal_pin_hook_t hal_hook = NULL;
+hal_timer hal_timers[HAL_NATIVE_TIMERS];
+bool hal_console = true;
+
+static bool hal_pin_valid(int pin) {
+  return (pin >= 0) && (pin < HAL_NATIVE_PINS);
+}
+
+static hal_timer* hal_timer_get(int timer) {
+  if ((timer < 0) || (timer >= HAL_NATIVE_TIMERS)) {
+    return NULL;
+  }
+
+  return &hal_timers[timer];
+}
+
+static void hal_timer_schedule(hal_timer *t, uint64_t now) {
+  // A compare below the counter matches after it wraps, as on the nRF52
+  for (int i = 0; i < HAL_NATIVE_CHANNELS; i++) {
+    uint64_t next = t->base + t->cc[i];
+    if (next <= now) {
+      next += HAL_TIMER_WRAP;
+    }
+    t->next[i] = next;
+  }
+}
+
+unsigned long hal_millis(void) {
+  return static_cast<unsigned long>(hal_now / 1000);
+}
+
+unsigned long hal_micros(void) {
+  return static_cast<unsigned long>(hal_now);
+}
+
+void hal_delay_us(unsigned long us) {
+  // Busy wait, nothing else runs but the clock moves on
+  hal_now += us;
+}
+
+void hal_pin_write(int pin, bool level) {
+  if (!hal_pin_valid(pin)) {
+    return;
+  }
+
+  hal_pins[pin] = level;
+  if (hal_hook) {
+    hal_hook(pin, level, hal_now);
+  }
+}
+
+bool hal_pin_read(int pin) {
+  if (!hal_pin_valid(pin)) {
+    return false;
+  }
+
+  return hal_pins[pin];
+}
+
+void hal_attach_isr(int pin, hal_isr_t isr) {
+  if (!hal_pin_valid(pin)) {
+    return;
+  }
+
+  hal_isrs[pin] = isr;
+}
+
+void hal_cycles_setup(void) {
+}
+
+uint32_t hal_cycles(void) {
+  // Host time in ns, not virtual time
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint32_t>(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+uint32_t hal_cycles_per_us(void) {
+  return 1000;
+}
+
+bool hal_console_ready(void) {
+  return hal_console;
+}
+
+int hal_console_space(void) {
+  return 4096;
+}
+
+void hal_console_write(const char *buf, int len) {
+  fwrite(buf, 1, len, stdout);
+}
+
+void hal_timer_attach(int timer, hal_timer_fire_t fire) {
+  hal_timer *t = hal_timer_get(timer);
+  if (!t) {
+    return;
+  }
+
+  memset(t, 0, sizeof(hal_timer));
+  t->fire = fire;
+}
+
+void hal_timer_set(int timer, int channel, uint32_t us, int mode) {
+  hal_timer *t = hal_timer_get(timer);
+  if (!t || (channel < 0) || (channel >= HAL_NATIVE_CHANNELS)) {
+    return;
+  }
+
+  t->cc[channel] = us;
+  t->mode[channel] = mode;
+  if (t->running) {
+    hal_timer_schedule(t, hal_now);
+  }
+}
+
+void hal_timer_run(int timer, bool run) {
+  hal_timer *t = hal_timer_get(timer);
+  if (!t || (t->running == run)) {
+    return;
+  }
+
+  if (run) {
+    t->base = hal_now - t->counter;
+    hal_timer_schedule(t, hal_now);
+  } else {
+    t->counter = hal_now - t->base;
+  }
+  t->running = run;
+}
+
+void hal_timer_clear(int timer) {
+  hal_timer *t = hal_timer_get(timer);
+  if (!t) {
+    return;
+  }
+
+  t->base = hal_now;
+  t->counter = 0;
+  if (t->running) {
+    hal_timer_schedule(t, hal_now);
+  }
+}
+
+void hal_native_reset(void) {
+  hal_now = 0;
+  memset(hal_pins, 0, sizeof(hal_pins));
+  memset(hal_isrs, 0, sizeof(hal_isrs));
+  memset(hal_timers, 0, sizeof(hal_timers));
+  hal_hook = NULL;
+}
+
+uint64_t hal_native_now(void) {
+  return hal_now;
+}
+
+static bool hal_native_first(hal_timer **timer, int *channel,
+                             uint64_t *when) {
+  // Earliest compare of any running timer
+  bool found = false;
+  for (int i = 0; i < HAL_NATIVE_TIMERS; i++) {
+    hal_timer *t = &hal_timers[i];
+    if (!t->running || !t->fire) {
+      continue;
+    }
+
+    for (int j = 0; j < HAL_NATIVE_CHANNELS; j++) {
+      if ((t->mode[j] == HAL_TIMER_OFF) || (found && (t->next[j] >= *when))) {
+        continue;
+      }
+      *timer = t;
+      *channel = j;
+      *when = t->next[j];
+      found = true;
+    }
+  }
+
+  return found;
+}
+
+uint64_t hal_native_next_timer(void) {
+  hal_timer *t;
+  int channel;
+  uint64_t when = UINT64_MAX;
+  hal_native_first(&t, &channel, &when);
+  return when;
+}
+
+void hal_native_advance(uint64_t until) {
+  hal_timer *t;
+  int channel;
+  uint64_t when;
+  while (hal_native_first(&t, &channel, &when) && (when <= until)) {
+    // A handler which busy waited past the compare makes this late
+    if (when > hal_now) {
+      hal_now = when;
+    }
+
+    // The shortcuts act in hardware, before the handler runs
+    switch (t->mode[channel]) {
+      case HAL_TIMER_PERIODIC:
+        // Compares missed while busy set the same event, so fire once
+        if (t->cc[channel] && (hal_now > when)) {
+          when += ((hal_now - when) / t->cc[channel]) * t->cc[channel];
+        }
+        t->base = when;
+        hal_timer_schedule(t, when);
+        break;
+      case HAL_TIMER_ONESHOT:
+        t->running = false;
+        t->counter = 0;
+        break;
+      default:
+        t->next[channel] += HAL_TIMER_WRAP;
+        break;
+    }
+
+    t->fire(channel);
+  }
+
+  if (until > hal_now) {
+    hal_now = until;
+  }
+}
+
+void hal_native_pin_set(int pin, bool level) {
+  if (!hal_pin_valid(pin) || (hal_pins[pin] == level)) {
+    return;
+  }
+
+  hal_pins[pin] = level;
+  if (hal_isrs[pin]) {
+    hal_isrs[pin]();
+  }
+}
+
+void hal_native_pin_hook(hal_pin_hook_t hook) {
+  hal_hook = hook;
+}
+
+void hal_native_console(bool enable) {
+  hal_console = enable;
+}
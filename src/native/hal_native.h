@@ -0,0 +1,155 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_NATIVE_HAL_NATIVE_H_
+#define SRC_NATIVE_HAL_NATIVE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+// Brought in by Arduino.h on the device
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Host implementation of hal.h. Time only moves when the host program
+// calls hal_native_advance() (or hal_delay_us() busy waits), so a run
+// is deterministic and as fast as the code under test. Input pins are
+// set with hal_native_pin_set(), which calls the attached ISR on a
+// change, and the timers fire their compare handlers as the clock
+// passes them.
+
+#define HAL_NATIVE_PINS         64
+#define HAL_NATIVE_TIMERS       5
+#define HAL_NATIVE_CHANNELS     6
+
+#define HAL_TIMER_OFF           0
+#define HAL_TIMER_COMPARE       1     // Free running counter
+#define HAL_TIMER_PERIODIC      2     // COMPARE->CLEAR
+#define HAL_TIMER_ONESHOT       3     // COMPARE->STOP
+
+typedef void (*hal_isr_t)(void);
+typedef void (*hal_timer_fire_t)(int channel);
+typedef void (*hal_pin_hook_t)(int pin, bool level, uint64_t now);
+
+unsigned long hal_millis(void);
+unsigned long hal_micros(void);
+void hal_delay_us(unsigned long us);
+void hal_pin_write(int pin, bool level);
+bool hal_pin_read(int pin);
+void hal_attach_isr(int pin, hal_isr_t isr);
+void hal_cycles_setup(void);
+uint32_t hal_cycles(void);
+uint32_t hal_cycles_per_us(void);
+bool hal_console_ready(void);
+int hal_console_space(void);
+void hal_console_write(const char *buf, int len);
+
+void hal_timer_attach(int timer, hal_timer_fire_t fire);
+void hal_timer_set(int timer, int channel, uint32_t us, int mode);
+void hal_timer_run(int timer, bool run);
+void hal_timer_clear(int timer);
+
+// Driven by the host program
+void hal_native_reset(void);
+uint64_t hal_native_now(void);
+uint64_t hal_native_next_timer(void);
+void hal_native_advance(uint64_t until);
+void hal_native_pin_set(int pin, bool level);
+void hal_native_pin_hook(hal_pin_hook_t hook);
+void hal_native_console(bool enable);
+
+// Same interface as InterruptTimer in inttimer.h. The prescaler is
+// ignored and the counter runs in us.
+
+#define INTTIMER_PRIORITY       5
+#define INTTIMER_MAX_CHANNELS   HAL_NATIVE_CHANNELS
+
+typedef void (*inttimer_handler_t)(void);
+
+typedef enum {
+  NRF_TIMER_FREQ_16MHz = 0,
+  NRF_TIMER_FREQ_8MHz,
+  NRF_TIMER_FREQ_4MHz,
+  NRF_TIMER_FREQ_2MHz,
+  NRF_TIMER_FREQ_1MHz,
+} nrf_timer_frequency_t;
+
+template <int N,
+          inttimer_handler_t CC0 = nullptr, inttimer_handler_t CC1 = nullptr,
+          inttimer_handler_t CC2 = nullptr, inttimer_handler_t CC3 = nullptr,
+          inttimer_handler_t CC4 = nullptr, inttimer_handler_t CC5 = nullptr>
+class InterruptTimer {
+ public:
+  static_assert((N > 0) && (N < HAL_NATIVE_TIMERS), "No such timer");
+  static_assert(((CC4 == nullptr) && (CC5 == nullptr)) || (N > 2),
+                "Timer has only 4 compare channels");
+
+  static void begin(nrf_timer_frequency_t freq = NRF_TIMER_FREQ_16MHz,
+                    uint8_t priority = INTTIMER_PRIORITY) {
+    (void) freq;
+    (void) priority;
+    hal_timer_attach(N, fire);
+  }
+
+  static void setPeriodic(int channel, uint32_t us) {
+    hal_timer_set(N, channel, us, HAL_TIMER_PERIODIC);
+  }
+
+  static void setOneShot(int channel, uint32_t us) {
+    hal_timer_set(N, channel, us, HAL_TIMER_ONESHOT);
+  }
+
+  static void setCompare(int channel, uint32_t us) {
+    hal_timer_set(N, channel, us, HAL_TIMER_COMPARE);
+  }
+
+  static void disable(int channel) {
+    hal_timer_set(N, channel, 0, HAL_TIMER_OFF);
+  }
+
+  static void start(void) {
+    hal_timer_run(N, true);
+  }
+
+  static void stop(void) {
+    hal_timer_run(N, false);
+  }
+
+  static void clear(void) {
+    hal_timer_clear(N);
+  }
+
+ private:
+  static void fire(int channel) {
+    const inttimer_handler_t handlers[] = {CC0, CC1, CC2, CC3, CC4, CC5};
+    if (handlers[channel] != nullptr) {
+      handlers[channel]();
+    }
+  }
+};
+
+#define INTTIMER_IRQ_HANDLER(n, timer)
+
+#endif  // SRC_NATIVE_HAL_NATIVE_H_
@@ -0,0 +1,78 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "hal.h"
+#include "indicator.h"
+#include "native/indicator_native.h"
+
+int indicator_native_last_status = NeoPixelIndicator::OFF;
+uint8_t indicator_native_levels[2] = {0, 0};
+
+NeoPixelIndicator indicator;
+
+NeoPixelIndicator::NeoPixelIndicator(void) {
+  neopixel = NULL;
+  strip = NULL;
+}
+
+NeoPixelIndicator::~NeoPixelIndicator(void) {
+}
+
+void NeoPixelIndicator::begin(void) {
+}
+
+void NeoPixelIndicator::setStatus(int status, int flash) {
+  (void) flash;
+  indicator_native_last_status = status;
+}
+
+void NeoPixelIndicator::setLevel(int display, uint8_t level) {
+  if ((display < 0) || (display > 1)) {
+    return;
+  }
+
+  indicator_native_levels[display] = level;
+}
+
+void NeoPixelIndicator::startupEffect(void) {
+}
+
+void NeoPixelIndicator::render(void) {
+}
+
+void NeoPixelIndicator::renderInBackground(bool enable) {
+  (void) enable;
+}
+
+int indicator_native_status(void) {
+  return indicator_native_last_status;
+}
+
+uint8_t indicator_native_level(int display) {
+  if ((display < 0) || (display > 1)) {
+    return 0;
+  }
+
+  return indicator_native_levels[display];
+}
@@ -0,0 +1,99 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Entry point of env:native. Runs the portable part of the firmware
+// (firmware.h) in the simulator (sim.h):
+//
+//   program [-h hours] [-f Hz] [-j jitter us] [-d dropout] [-g glitch]
+//           [-l sensor loss] [-m mean mph] [-w swing mph] [-s seed] [-v]
+//
+// -v prints the firmware log, which needs -DDEBUG_OUTPUT.
+//
+// Unit tests bring their own main() and leave this out.
+
+#ifndef PIO_UNIT_TESTING
+
+#include <unistd.h>
+#include "hal.h"
+#include "triac.h"
+#include "native/firmware.h"
+#include "native/sim.h"
+
+int main(int argc, char *argv[]) {
+  sim_config cfg;
+  sim_defaults(&cfg);
+  bool verbose = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "h:f:j:d:g:l:m:w:s:v")) != -1) {
+    switch (opt) {
+      case 'h':
+        cfg.duration = llround(atof(optarg) * 3.6e9);
+        break;
+      case 'f':
+        cfg.mains_freq = atof(optarg);
+        break;
+      case 'j':
+        cfg.mains_jitter = atof(optarg);
+        break;
+      case 'd':
+        cfg.mains_dropout = atof(optarg);
+        break;
+      case 'g':
+        cfg.mains_glitch = atof(optarg);
+        break;
+      case 'l':
+        cfg.sensor_dropout = atof(optarg);
+        break;
+      case 'm':
+        cfg.speed_mean = atof(optarg);
+        break;
+      case 'w':
+        cfg.speed_swing = atof(optarg);
+        break;
+      case 's':
+        cfg.seed = strtoul(optarg, NULL, 0);
+        break;
+      case 'v':
+        // Firmware debug output
+        verbose = true;
+        break;
+      default:
+        fprintf(stderr, "Unknown option %c\n", opt);
+        return 1;
+    }
+  }
+
+  hal_native_console(verbose);
+  firmware_setup();
+
+  sim_run(&cfg, firmware_loop);
+
+  sim_print();
+  printf("Mains %.2f Hz, %lu timer ticks\n",
+    static_cast<double>(get_mains_freq()), hardtimer_count);
+  return 0;
+}
+
+#endif  // PIO_UNIT_TESTING
@@ -0,0 +1,203 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Entry point of env:replay. Reads a sensor trace (TRACnnnn.BIN, see
+// ridelog.h) and runs it through the parsers in BLEClient.cpp and the
+// control loop, in the simulator (sim.h) so faster than real time:
+//
+//   program [-o timeline.csv] [-f Hz] [-j jitter us] [-v] TRACnnnn.BIN
+//
+// The timeline has a row for each change of the fan outputs, with the
+// time in seconds from the first notification. The latency from the
+// notifications to the fans is printed at the end.
+//
+// Unit tests bring their own main() and leave this out.
+
+#ifndef PIO_UNIT_TESTING
+
+#include <unistd.h>
+#include "hal.h"
+#include "bluetooth.h"
+#include "control.h"
+#include "sensor.h"
+#include "latency.h"
+#include "ridelog.h"
+#include "native/firmware.h"
+#include "native/sim.h"
+
+#define REPLAY_TAIL             (SENSOR_TIMEOUT * 2)  // ms run after
+
+FILE *replay_timeline = NULL;
+int replay_op[CONTROL_NUM_FANS] = {-1, -1};
+
+static int replay_read(const char *filename, ridelog_trace_record **trace) {
+  // All records up to the first unused, corrupt or out of order sector,
+  // or one left in the file by another session
+  FILE *f = fopen(filename, "rb");
+  if (!f) {
+    return -1;
+  }
+
+  static uint8_t sector[RIDELOG_SECTOR_SIZE];
+  ridelog_trace_record *records = NULL;
+  int count = 0;
+  uint32_t session = 0;
+  for (uint32_t seq = 0;
+       fread(sector, 1, sizeof(sector), f) == sizeof(sector); seq++) {
+    const ridelog_header *header =
+      reinterpret_cast<const ridelog_header*>(sector);
+    int err = ridelog_sector_check(sector, RIDELOG_TRACE_MAGIC,
+      sizeof(ridelog_trace_record), seq, seq ? &session : NULL);
+    if (err) {
+      if (err == -4) {
+        fprintf(stderr, "CRC error in sector %u\n", seq);
+      }
+      break;
+    }
+    session = header->session;
+
+    size_t len = header->count * sizeof(ridelog_trace_record);
+
+    records = static_cast<ridelog_trace_record*>(
+      realloc(records, (count + header->count) * sizeof(*records)));
+    memcpy(&records[count], &sector[sizeof(ridelog_header)], len);
+    count += header->count;
+  }
+
+  fclose(f);
+  *trace = records;
+  return count;
+}
+
+static void replay_loop(void) {
+  firmware_loop();
+
+  bool changed = false;
+  for (int i = 0; i < CONTROL_NUM_FANS; i++) {
+    int op = control_get_output(i);
+    changed |= (op != replay_op[i]);
+    replay_op[i] = op;
+  }
+
+  if (changed && replay_timeline) {
+    fprintf(replay_timeline, "%.3f,%.2f,%d,%d,%d\n", hal_micros() / 1e6,
+      static_cast<double>(control_get_speed()), replay_op[0], replay_op[1],
+      sensor_get_source());
+  }
+}
+
+static void replay_print_latency(void) {
+  static const char* const names[LATENCY_NUM_STAGES] = {
+    "control", "fire", "total"
+  };
+
+  for (int i = 0; i < LATENCY_NUM_STAGES; i++) {
+    const histogram *h = latency_get(i);
+    if (!h->count) {
+      printf("Latency %-7s : none\n", names[i]);
+      continue;
+    }
+    printf("Latency %-7s : count = %lu min = %lu max = %lu mean = %lu us\n",
+      names[i], static_cast<unsigned long>(h->count),
+      static_cast<unsigned long>(h->min), static_cast<unsigned long>(h->max),
+      static_cast<unsigned long>(histogram_mean(h)));
+  }
+  printf("Latency SLO misses %lu\n", latency_slo_misses());
+}
+
+int main(int argc, char *argv[]) {
+  sim_config cfg;
+  sim_defaults(&cfg);
+  bool verbose = false;
+  const char *timeline = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "o:f:j:v")) != -1) {
+    switch (opt) {
+      case 'o':
+        timeline = optarg;
+        break;
+      case 'f':
+        cfg.mains_freq = atof(optarg);
+        break;
+      case 'j':
+        cfg.mains_jitter = atof(optarg);
+        break;
+      case 'v':
+        // Firmware debug output
+        verbose = true;
+        break;
+      default:
+        fprintf(stderr, "Unknown option %c\n", opt);
+        return 1;
+    }
+  }
+
+  if (optind >= argc) {
+    fprintf(stderr, "No trace file\n");
+    return 1;
+  }
+
+  ridelog_trace_record *trace;
+  int count = replay_read(argv[optind], &trace);
+  if (count <= 0) {
+    fprintf(stderr, "No records in %s\n", argv[optind]);
+    return 1;
+  }
+
+  if (timeline) {
+    replay_timeline = fopen(timeline, "w");
+    if (!replay_timeline) {
+      fprintf(stderr, "Unable to open %s\n", timeline);
+      return 1;
+    }
+    fprintf(replay_timeline, "time,speed,op1,op2,source\n");
+  }
+
+  // Same spacing as recorded, then long enough for the sensor to time out
+  uint64_t span = 0;
+  for (int i = 1; i < count; i++) {
+    span += static_cast<uint32_t>(trace[i].time - trace[i - 1].time);
+  }
+  cfg.trace = trace;
+  cfg.trace_count = count;
+  cfg.duration = span + (REPLAY_TAIL * 1000ULL);
+
+  hal_native_console(verbose);
+  firmware_setup();
+
+  sim_run(&cfg, replay_loop);
+
+  printf("Replayed %d notifications over %.1f s\n", count, span / 1e6);
+  sim_print();
+  replay_print_latency();
+
+  if (replay_timeline) {
+    fclose(replay_timeline);
+  }
+  free(trace);
+  return 0;
+}
+
+#endif  // PIO_UNIT_TESTING
@@ -0,0 +1,407 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "hal.h"
+#include "wiring.h"
+#include "config.h"
+#include "control.h"
+#include "native/bluetooth_native.h"
+#include "native/sim.h"
+
+#define SIM_SLOT(k)             ((k) & (SIM_HALF_CYCLES - 1))
+
+sim_config sim_cfg;
+sim_event sim_queue[SIM_MAX_EVENTS];
+int sim_queue_len = 0;
+uint32_t sim_seq = 0;
+uint32_t sim_rand_state = 1;
+double sim_half_period = 0;
+long sim_last = -1;                   // Last true zero crossing
+uint32_t sim_expected[SIM_HALF_CYCLES][CONTROL_NUM_FANS];
+uint16_t sim_fired[SIM_HALF_CYCLES][CONTROL_NUM_FANS];
+int sim_trace_index = 0;
+sim_fan_stats sim_fans[CONTROL_NUM_FANS];
+sim_totals sim_total;
+
+static uint32_t sim_rand(void) {
+  // xorshift32, the same seed gives the same run
+  uint32_t x = sim_rand_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  sim_rand_state = x;
+  return x;
+}
+
+static double sim_uniform(void) {
+  // In (0, 1]
+  return ((sim_rand() >> 8) + 1) / 16777216.0;
+}
+
+static double sim_gauss(void) {
+  return sqrt(-2.0 * log(sim_uniform())) * cos(2.0 * M_PI * sim_uniform());
+}
+
+static uint64_t sim_time(long k) {
+  // Time of true zero crossing k, crossing -1 is at the start
+  return llround((k + 1) * sim_half_period);
+}
+
+static bool sim_before(const sim_event *a, const sim_event *b) {
+  return (a->time < b->time) || ((a->time == b->time) && (a->seq < b->seq));
+}
+
+static void sim_push(uint64_t time, uint8_t type, uint8_t arg) {
+  if (sim_queue_len >= SIM_MAX_EVENTS) {
+    fprintf(stderr, "Simulator event queue full\n");
+    return;
+  }
+
+  // Sift up the binary heap
+  sim_event ev = {time, sim_seq++, type, arg};
+  int i = sim_queue_len++;
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (!sim_before(&ev, &sim_queue[parent])) {
+      break;
+    }
+    sim_queue[i] = sim_queue[parent];
+    i = parent;
+  }
+  sim_queue[i] = ev;
+}
+
+static sim_event sim_pop(void) {
+  sim_event top = sim_queue[0];
+  sim_event last = sim_queue[--sim_queue_len];
+
+  // Sift down the last event from the root
+  int i = 0;
+  for (;;) {
+    int child = (2 * i) + 1;
+    if (child >= sim_queue_len) {
+      break;
+    }
+    if (((child + 1) < sim_queue_len)
+        && sim_before(&sim_queue[child + 1], &sim_queue[child])) {
+      child++;
+    }
+    if (!sim_before(&sim_queue[child], &last)) {
+      break;
+    }
+    sim_queue[i] = sim_queue[child];
+    i = child;
+  }
+  sim_queue[i] = last;
+
+  return top;
+}
+
+static uint32_t sim_ideal_delay(int fan) {
+  // Phase delay the firmware is aiming for, zero when off
+  uint32_t delay = config_get_live()->triac_delay[control_get_output(fan)];
+  if (delay >= sim_half_period) {
+    return 0;
+  }
+  return delay;
+}
+
+static void sim_record(int fan, int64_t error) {
+  sim_fan_stats *s = &sim_fans[fan];
+  s->pulses++;
+  s->sum += error;
+  s->sum_sq += static_cast<double>(error) * error;
+  if (error < s->min) {
+    s->min = error;
+  }
+  if (error > s->max) {
+    s->max = error;
+  }
+
+  if ((error < -SIM_ERROR_RANGE) || (error > SIM_ERROR_RANGE)) {
+    s->outside++;
+  } else {
+    s->bins[error + SIM_ERROR_RANGE]++;
+  }
+}
+
+static void sim_pin_hook(int pin, bool level, uint64_t now) {
+  int fan;
+  if (pin == PIN_FAN_1) {
+    fan = 0;
+  } else if (pin == PIN_FAN_2) {
+    fan = 1;
+  } else {
+    return;
+  }
+
+  if (!level) {
+    return;
+  }
+
+  // Measure from the nearest crossing, the detector pulse starts
+  // before the true crossing so an early pulse belongs to the next one
+  int64_t delay = config_get_live()->triac_delay[control_get_output(fan)];
+  long k = sim_last;
+  int64_t error = static_cast<int64_t>(now - sim_time(k)) - delay;
+  int64_t next = static_cast<int64_t>(now - sim_time(k + 1)) - delay;
+  if (llabs(next) < llabs(error)) {
+    error = next;
+    k++;
+  }
+
+  if (sim_fired[SIM_SLOT(k)][fan]++) {
+    sim_fans[fan].extra++;
+  }
+  sim_record(fan, error);
+}
+
+static void sim_schedule_crossing(long k) {
+  // Detector pulse around crossing k, and any glitch in the half cycle
+  // before it
+  uint64_t t = sim_time(k);
+  uint64_t prev = sim_time(k - 1);
+  sim_push(t, SIM_EVENT_ZERO_CROSS, 0);
+
+  if (sim_uniform() < sim_cfg.mains_dropout) {
+    sim_total.dropouts++;
+  } else {
+    double centre = t + (sim_cfg.mains_jitter * sim_gauss());
+    double fall = centre - (sim_cfg.clock_pulse / 2.0);
+    if (fall <= prev) {
+      fall = prev + 1;
+    }
+    sim_push(llround(fall), SIM_EVENT_CLOCK, 0);
+    sim_push(llround(fall) + sim_cfg.clock_pulse, SIM_EVENT_CLOCK, 1);
+  }
+
+  if (sim_uniform() < sim_cfg.mains_glitch) {
+    uint64_t start = prev + llround(sim_uniform() * sim_half_period);
+    uint32_t len = SIM_GLITCH_MIN
+      + (sim_rand() % (SIM_GLITCH_MAX - SIM_GLITCH_MIN + 1));
+    sim_push(start, SIM_EVENT_CLOCK, 0);
+    sim_push(start + len, SIM_EVENT_CLOCK, 1);
+    sim_total.glitches++;
+  }
+}
+
+static void sim_zero_cross(void) {
+  long k = ++sim_last;
+
+  // Late pulses for the last crossing may still come, so check the one
+  // before and free its slot for an early pulse of the next crossing
+  if (k >= 2) {
+    for (int i = 0; i < CONTROL_NUM_FANS; i++) {
+      if (sim_expected[SIM_SLOT(k - 2)][i]
+          && !sim_fired[SIM_SLOT(k - 2)][i]) {
+        sim_fans[i].missed++;
+      }
+      sim_expected[SIM_SLOT(k - 2)][i] = 0;
+      sim_fired[SIM_SLOT(k - 2)][i] = 0;
+    }
+  }
+
+  for (int i = 0; i < CONTROL_NUM_FANS; i++) {
+    sim_expected[SIM_SLOT(k)][i] = sim_ideal_delay(i);
+  }
+
+  sim_total.crossings++;
+  sim_schedule_crossing(k + 1);
+}
+
+static void sim_sensor(uint64_t now) {
+  if (sim_uniform() < sim_cfg.sensor_dropout) {
+    sim_total.sensor_dropouts++;
+    return;
+  }
+
+  double t = now / 1e6;
+  double speed = sim_cfg.speed_mean;
+  if (sim_cfg.speed_period) {
+    speed += sim_cfg.speed_swing
+      * sin(2.0 * M_PI * t / sim_cfg.speed_period);
+  }
+  if (speed < 0) {
+    speed = 0;
+  }
+
+  bluetooth_native_sensor(speed, static_cast<int>(speed * 10));
+  sim_total.sensor_samples++;
+}
+
+static void sim_trace(uint64_t now) {
+  // Deliver the next record and keep the spacing to the one after,
+  // the recorded micros() wrap so only the difference is used
+  const ridelog_trace_record *rec = &sim_cfg.trace[sim_trace_index++];
+  uint8_t data[RIDELOG_TRACE_DATA];
+  memcpy(data, rec->data, sizeof(data));
+  bluetooth_native_notify(rec->type, data, rec->len);
+  sim_total.sensor_samples++;
+
+  if (sim_trace_index < sim_cfg.trace_count) {
+    uint32_t gap = sim_cfg.trace[sim_trace_index].time - rec->time;
+    sim_push(now + gap, SIM_EVENT_SENSOR, 0);
+  }
+}
+
+void sim_defaults(sim_config *cfg) {
+  cfg->mains_freq = 50;
+  cfg->mains_jitter = 20;
+  cfg->mains_dropout = 0;
+  cfg->mains_glitch = 0;
+  cfg->clock_pulse = 400;
+  cfg->loop_period = 1000;
+  cfg->sensor_period = 1000;
+  cfg->sensor_dropout = 0;
+  cfg->speed_mean = 15;
+  cfg->speed_swing = 10;
+  cfg->speed_period = 600;
+  cfg->trace = NULL;
+  cfg->trace_count = 0;
+  cfg->seed = 1;
+  cfg->duration = 3600ULL * 1000000ULL;
+}
+
+void sim_run(const sim_config *cfg, void (*loop)(void)) {
+  // The firmware must already be set up on a reset hal_native
+  sim_cfg = *cfg;
+  sim_rand_state = cfg->seed ? cfg->seed : 1;
+  sim_half_period = 1e6 / (2.0 * cfg->mains_freq);
+  sim_queue_len = 0;
+  sim_seq = 0;
+  sim_last = -1;
+  sim_trace_index = 0;
+  memset(sim_expected, 0, sizeof(sim_expected));
+  memset(sim_fired, 0, sizeof(sim_fired));
+  memset(&sim_total, 0, sizeof(sim_total));
+  memset(sim_fans, 0, sizeof(sim_fans));
+  for (int i = 0; i < CONTROL_NUM_FANS; i++) {
+    sim_fans[i].min = INT32_MAX;
+    sim_fans[i].max = INT32_MIN;
+  }
+
+  hal_native_pin_hook(sim_pin_hook);
+  hal_native_pin_set(PIN_MAINS_CLOCK, true);
+  bluetooth_native_set_connected(true, false);
+
+  sim_schedule_crossing(0);
+  if (!cfg->trace || cfg->trace_count) {
+    sim_push(0, SIM_EVENT_SENSOR, 0);
+  }
+  sim_push(0, SIM_EVENT_LOOP, 0);
+
+  while (sim_queue_len) {
+    sim_event ev = sim_pop();
+    if (ev.time > cfg->duration) {
+      break;
+    }
+
+    // Timer interrupts up to the event
+    hal_native_advance(ev.time);
+
+    switch (ev.type) {
+      case SIM_EVENT_ZERO_CROSS:
+        sim_zero_cross();
+        break;
+      case SIM_EVENT_CLOCK:
+        hal_native_pin_set(PIN_MAINS_CLOCK, ev.arg);
+        break;
+      case SIM_EVENT_SENSOR:
+        if (cfg->trace) {
+          sim_trace(ev.time);
+          break;
+        }
+        sim_sensor(ev.time);
+        sim_push(ev.time + (cfg->sensor_period * 1000ULL),
+          SIM_EVENT_SENSOR, 0);
+        break;
+      case SIM_EVENT_LOOP:
+        loop();
+        sim_total.loops++;
+        sim_push(ev.time + cfg->loop_period, SIM_EVENT_LOOP, 0);
+        break;
+    }
+  }
+
+  hal_native_pin_hook(NULL);
+}
+
+const sim_fan_stats* sim_get_fan(int fan) {
+  if ((fan < 0) || (fan >= CONTROL_NUM_FANS)) {
+    return NULL;
+  }
+
+  return &sim_fans[fan];
+}
+
+const sim_totals* sim_get_totals(void) {
+  return &sim_total;
+}
+
+static int32_t sim_percentile(const sim_fan_stats *s, double p) {
+  // Error below which p of the pulses fell, those outside the range are
+  // counted at its ends
+  uint64_t below = 0;
+  for (int i = 0; i < static_cast<int>(sizeof(s->bins) / 4); i++) {
+    below += s->bins[i];
+    if (below >= (p * s->pulses)) {
+      return i - SIM_ERROR_RANGE;
+    }
+  }
+  return SIM_ERROR_RANGE;
+}
+
+void sim_print(void) {
+  double degrees = 180.0 / sim_half_period;
+  double hours = sim_cfg.duration / 3.6e9;
+
+  printf("Simulated %.2f h at %.1f Hz : %lu crossings, %lu dropouts, "
+    "%lu glitches\n", hours, static_cast<double>(sim_cfg.mains_freq),
+    sim_total.crossings, sim_total.dropouts, sim_total.glitches);
+  printf("Sensor samples %lu (%lu lost), loops %lu\n",
+    sim_total.sensor_samples, sim_total.sensor_dropouts, sim_total.loops);
+
+  for (int i = 0; i < CONTROL_NUM_FANS; i++) {
+    const sim_fan_stats *s = &sim_fans[i];
+    printf("Fan %d : pulses = %lu missed = %lu extra = %lu outside = %lu\n",
+      i + 1, s->pulses, s->missed, s->extra, s->outside);
+    if (!s->pulses) {
+      continue;
+    }
+
+    double mean = static_cast<double>(s->sum) / s->pulses;
+    double sd = sqrt((s->sum_sq / s->pulses) - (mean * mean));
+    printf("  error us  : mean = %.1f sd = %.1f min = %d max = %d\n",
+      mean, sd, s->min, s->max);
+    printf("  error deg : mean = %.2f sd = %.2f min = %.2f max = %.2f\n",
+      mean * degrees, sd * degrees, s->min * degrees, s->max * degrees);
+
+    static const double points[] = {0.001, 0.01, 0.5, 0.99, 0.999};
+    printf("  percentile us :");
+    for (size_t j = 0; j < sizeof(points) / sizeof(points[0]); j++) {
+      printf(" p%g = %d", points[j] * 100, sim_percentile(s, points[j]));
+    }
+    printf("\n");
+  }
+}
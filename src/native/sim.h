@@ -0,0 +1,110 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_NATIVE_SIM_H_
+#define SRC_NATIVE_SIM_H_
+
+#include <stdint.h>
+#include "ridelog.h"
+
+// Discrete event simulation of the mains, the zero crossing detector
+// and the bike sensors around the real triac, control and sensor code.
+// Events are kept in time order and the clock jumps from one to the
+// next, with the triac timer firing in between through hal_native.
+// Every gate pulse is compared with the ideal firing time, which is the
+// phase delay for the current output after the true zero crossing.
+//
+// The detector gives a low pulse centred on each zero crossing. Each
+// pulse can be moved by jitter or lost, and spurious short pulses can
+// be added to model a noisy mains.
+//
+// The sensor either follows a speed profile or replays a recorded
+// trace of notifications (ridelog.h) with their original spacing.
+
+#define SIM_MAX_EVENTS          32
+#define SIM_ERROR_RANGE         2000  // us either side of the ideal time
+#define SIM_GLITCH_MIN          2     // us length of a spurious pulse
+#define SIM_GLITCH_MAX          50
+#define SIM_HALF_CYCLES         4     // Kept for late pulses, power of 2
+
+#define SIM_EVENT_ZERO_CROSS    0     // True zero crossing
+#define SIM_EVENT_CLOCK         1     // Edge from the detector, arg = level
+#define SIM_EVENT_SENSOR        2     // Speed and power notification
+                                      // or the next trace record
+#define SIM_EVENT_LOOP          3     // Call of loop()
+
+typedef struct {
+  uint64_t time;                      // us
+  uint32_t seq;                       // Keeps events at the same time in order
+  uint8_t type;
+  uint8_t arg;
+} sim_event;
+
+typedef struct {
+  float mains_freq;                   // Hz
+  float mains_jitter;                 // us rms on each detector pulse
+  float mains_dropout;                // Chance a detector pulse is lost
+  float mains_glitch;                 // Chance of a spurious pulse
+                                      // in each half cycle
+  uint32_t clock_pulse;               // us low around each zero crossing
+  uint32_t loop_period;               // us between calls of loop()
+  uint32_t sensor_period;             // ms between notifications
+  float sensor_dropout;               // Chance a notification is lost
+  float speed_mean;                   // mph
+  float speed_swing;                  // mph either side of the mean
+  uint32_t speed_period;              // s for one cycle of the swing
+  const ridelog_trace_record *trace;  // Replayed in place of the speed
+  int trace_count;                    // profile when not NULL
+  uint32_t seed;
+  uint64_t duration;                  // us
+} sim_config;
+
+typedef struct {
+  unsigned long pulses;
+  unsigned long missed;               // Half cycles which should have fired
+  unsigned long extra;                // Further pulses in a half cycle
+  unsigned long outside;              // Error beyond SIM_ERROR_RANGE
+  int32_t min;                        // us, actual - ideal
+  int32_t max;
+  int64_t sum;
+  double sum_sq;
+  uint32_t bins[(2 * SIM_ERROR_RANGE) + 1];  // 1 us each
+} sim_fan_stats;
+
+typedef struct {
+  unsigned long crossings;
+  unsigned long dropouts;
+  unsigned long glitches;
+  unsigned long sensor_samples;
+  unsigned long sensor_dropouts;
+  unsigned long loops;
+} sim_totals;
+
+void sim_defaults(sim_config *cfg);
+void sim_run(const sim_config *cfg, void (*loop)(void));
+const sim_fan_stats* sim_get_fan(int fan);
+const sim_totals* sim_get_totals(void);
+void sim_print(void);
+
+#endif  // SRC_NATIVE_SIM_H_
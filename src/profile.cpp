@@ -0,0 +1,84 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "hal.h"
+#include "debug.h"
+#include "profile.h"
+
+#ifdef PROFILE_TIMING
+
+histogram profile_sites[PROFILE_NUM_SITES];
+unsigned long profile_print_millis = 0;
+
+static const char* const profile_names[PROFILE_NUM_SITES] = {
+  "hardtimer", "zero_cross", "indicator", "loop"
+};
+
+void profile_setup(void) {
+  hal_cycles_setup();
+
+  for (int i = 0; i < PROFILE_NUM_SITES; i++) {
+    profile_reset(i);
+  }
+}
+
+void profile_record(int site, uint32_t cycles) {
+  // Each site is only recorded from one context so no locking
+  histogram_record(&profile_sites[site], cycles);
+}
+
+const histogram* profile_get(int site) {
+  if ((site < 0) || (site >= PROFILE_NUM_SITES)) {
+    return NULL;
+  }
+
+  return &profile_sites[site];
+}
+
+void profile_reset(int site) {
+  if ((site < 0) || (site >= PROFILE_NUM_SITES)) {
+    return;
+  }
+
+  histogram_reset(&profile_sites[site]);
+}
+
+void profile_loop(void) {
+  if ((hal_millis() - profile_print_millis) < PROFILE_PRINT_PERIOD) {
+    return;
+  }
+  profile_print_millis = hal_millis();
+
+  for (int i = 0; i < PROFILE_NUM_SITES; i++) {
+    const histogram *s = &profile_sites[i];
+    if (!s->count) {
+      continue;
+    }
+
+    LOG_INFO("%s : count = %lu min = %lu max = %lu mean = %lu cycles\n",
+      profile_names[i], s->count, s->min, s->max, histogram_mean(s));
+  }
+}
+
+#endif
@@ -0,0 +1,73 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_PROFILE_H_
+#define SRC_PROFILE_H_
+
+#include <stdint.h>
+#include "histogram.h"
+
+// Timing of interrupts and the main loop using the DWT cycle counter
+// (host time in ns on env:native).
+// Everything here compiles to nothing unless PROFILE_TIMING is defined.
+
+#define PROFILE_HARDTIMER       0
+#define PROFILE_ZERO_CROSS      1
+#define PROFILE_INDICATOR       2
+#define PROFILE_LOOP            3
+#define PROFILE_NUM_SITES       4
+#define PROFILE_PRINT_PERIOD    10000
+
+#ifdef PROFILE_TIMING
+
+#include "hal.h"
+
+#define PROFILE_START() \
+  uint32_t _profile_start = profile_cycles()
+#define PROFILE_END(site) \
+  profile_record(site, profile_cycles() - _profile_start)
+
+static inline uint32_t profile_cycles(void) {
+  return hal_cycles();
+}
+
+void profile_setup(void);
+void profile_loop(void);
+void profile_record(int site, uint32_t cycles);
+const histogram* profile_get(int site);
+void profile_reset(int site);
+
+#else
+
+#define PROFILE_START() \
+  do {} while (0)
+#define PROFILE_END(site) \
+  do {} while (0)
+
+static inline void profile_setup(void) {}
+static inline void profile_loop(void) {}
+
+#endif
+
+#endif  // SRC_PROFILE_H_
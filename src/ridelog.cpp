@@ -0,0 +1,351 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <Arduino.h>
+#include <SdFat.h>
+#include <Adafruit_TinyUSB.h>
+#include <nrf_soc.h>
+#include "debug.h"
+#include "config.h"
+#include "file.h"
+#include "bluetooth.h"
+#include "control.h"
+#include "sensor.h"
+#include "triac.h"
+#include "ridelog.h"
+
+// A preallocated file written one sector at a time. Records are
+// appended to the sector buffer in RAM until it is full.
+typedef struct {
+  const char *prefix;
+  uint32_t magic;
+  uint8_t record_size;
+  int records;                      // Per sector
+  File file;
+  bool open;
+  uint32_t sector;
+  uint32_t sectors;
+  uint32_t session;
+  int count;
+  uint8_t buffer[RIDELOG_SECTOR_SIZE];
+} ridelog_stream;
+
+ridelog_stream ridelog_ride = {"RIDE", RIDELOG_MAGIC,
+  sizeof(ridelog_record), RIDELOG_RECORDS};
+ridelog_stream ridelog_traces = {"TRAC", RIDELOG_TRACE_MAGIC,
+  sizeof(ridelog_trace_record), RIDELOG_TRACE_RECORDS};
+
+bool ridelog_failed = false;
+int ridelog_index = 0;
+unsigned long ridelog_sample_millis = 0;
+unsigned long ridelog_active_millis = 0;
+
+// Notifications arrive in the bluetooth task and are passed to loop()
+// through a single producer ring
+ridelog_trace_record ridelog_trace_ring[RIDELOG_TRACE_RING];
+uint32_t ridelog_trace_head = 0;
+uint32_t ridelog_trace_tail = 0;
+volatile bool ridelog_tracing = false;
+unsigned long ridelog_trace_drops = 0;
+
+static uint8_t* ridelog_next(ridelog_stream *s) {
+  return &s->buffer[sizeof(ridelog_header) + (s->count * s->record_size)];
+}
+
+static uint32_t ridelog_nonce(void) {
+  // From the SoftDevice RNG, micros() is only there in case the pool is
+  // empty
+  uint32_t nonce = 0;
+  sd_rand_application_vector_get(reinterpret_cast<uint8_t*>(&nonce),
+    sizeof(nonce));
+  return nonce ^ micros();
+}
+
+static bool ridelog_open_stream(ridelog_stream *s, uint32_t size,
+                                uint32_t session) {
+  char filename[16];
+  snprintf(filename, sizeof(filename), "%s%04d.BIN", s->prefix,
+    ridelog_index);
+
+  // A trace left from a deleted ride log is replaced. The new file will
+  // usually get the same clusters, its old sectors are told apart by
+  // the session nonce.
+  if (fatfs.exists(filename)) {
+    fatfs.remove(filename);
+  }
+
+  if (!s->file.createContiguous(filename, size)) {
+    LOG_ERROR("Ride log : unable to allocate %s (%lu bytes)\n",
+      filename, static_cast<unsigned long>(size));
+    return false;
+  }
+
+  s->open = true;
+  s->sector = 0;
+  s->sectors = size / RIDELOG_SECTOR_SIZE;
+  s->session = session;
+  s->count = 0;
+
+  LOG_INFO("Ride log : started %s\n", filename);
+  return true;
+}
+
+static bool ridelog_write(ridelog_stream *s) {
+  // Write the sector buffer and start the next one
+  ridelog_sector_seal(s->buffer, s->magic, s->record_size, s->count,
+    s->sector, s->session);
+  s->count = 0;
+
+  s->file.seekSet(s->sector * RIDELOG_SECTOR_SIZE);
+  if (s->file.write(s->buffer, RIDELOG_SECTOR_SIZE) != RIDELOG_SECTOR_SIZE) {
+    LOG_ERROR("Ride log : write failed\n");
+    return false;
+  }
+  s->file.sync();
+  file_cache_invalidate();
+
+  s->sector++;
+  return true;
+}
+
+static void ridelog_close_stream(ridelog_stream *s) {
+  if (!s->open) {
+    return;
+  }
+
+  // A partial sector is only written when the session ends
+  if (s->count) {
+    ridelog_write(s);
+  }
+  s->file.close();
+  s->open = false;
+
+  LOG_INFO("Ride log : closed %s after %lu sectors\n", s->prefix,
+    static_cast<unsigned long>(s->sector));
+}
+
+static bool ridelog_start(void) {
+  // Find the next free file name
+  char filename[16];
+  for (; ridelog_index < RIDELOG_MAX_FILES; ridelog_index++) {
+    snprintf(filename, sizeof(filename), "RIDE%04d.BIN", ridelog_index);
+    if (!fatfs.exists(filename)) {
+      break;
+    }
+  }
+
+  if (ridelog_index >= RIDELOG_MAX_FILES) {
+    LOG_ERROR("Ride log : no free file names\n");
+    return false;
+  }
+
+  // Preallocate so that sector writes never touch the FAT
+  uint32_t size = static_cast<uint32_t>(config_get()->ridelog_size) * 1024;
+  size -= size % RIDELOG_SECTOR_SIZE;
+  if (!size) {
+    size = RIDELOG_SECTOR_SIZE;
+  }
+
+  uint32_t session = ridelog_nonce();
+  if (!ridelog_open_stream(&ridelog_ride, size, session)) {
+    return false;
+  }
+
+  if (config_get()->ridelog_trace) {
+    if (!ridelog_open_stream(&ridelog_traces, size, session)) {
+      ridelog_close_stream(&ridelog_ride);
+      return false;
+    }
+
+    // Start from an empty ring
+    ridelog_trace_tail = __atomic_load_n(&ridelog_trace_head,
+                                         __ATOMIC_ACQUIRE);
+    ridelog_tracing = true;
+  }
+
+  ridelog_index++;
+  return true;
+}
+
+void ridelog_close(void) {
+  ridelog_tracing = false;
+  ridelog_close_stream(&ridelog_ride);
+  ridelog_close_stream(&ridelog_traces);
+}
+
+static void ridelog_abandon_stream(ridelog_stream *s) {
+  // End the session without writing. Each write is followed by a sync,
+  // so the close has nothing left to update and the records still in
+  // the sector buffer are lost.
+  if (!s->open) {
+    return;
+  }
+
+  s->file.close();
+  s->open = false;
+
+  LOG_WARN("Ride log : %s ended by USB after %lu sectors\n", s->prefix,
+    static_cast<unsigned long>(s->sector));
+}
+
+bool ridelog_active(void) {
+  return ridelog_ride.open;
+}
+
+void ridelog_trace(uint8_t type, const uint8_t *data, uint16_t len) {
+  // Called from the bluetooth task for each notification
+  if (!ridelog_tracing) {
+    return;
+  }
+
+  uint32_t head = ridelog_trace_head;
+  uint32_t tail = __atomic_load_n(&ridelog_trace_tail, __ATOMIC_ACQUIRE);
+  if ((head - tail) >= RIDELOG_TRACE_RING) {
+    ridelog_trace_drops++;
+    return;
+  }
+
+  ridelog_trace_record *rec =
+    &ridelog_trace_ring[head & (RIDELOG_TRACE_RING - 1)];
+  if (len > RIDELOG_TRACE_DATA) {
+    len = RIDELOG_TRACE_DATA;
+  }
+  rec->time = micros();
+  rec->type = type;
+  rec->len = len;
+  memcpy(rec->data, data, len);
+  memset(&rec->data[len], 0, RIDELOG_TRACE_DATA - len);
+
+  __atomic_store_n(&ridelog_trace_head, head + 1, __ATOMIC_RELEASE);
+}
+
+unsigned long ridelog_trace_dropped(void) {
+  return ridelog_trace_drops;
+}
+
+static bool ridelog_append(ridelog_stream *s) {
+  // Count the record at ridelog_next(), false when the session must end
+  if (++s->count < s->records) {
+    return true;
+  }
+
+  if (!ridelog_write(s)) {
+    ridelog_failed = true;
+    return false;
+  }
+
+  if (s->sector >= s->sectors) {
+    // Carry on in a new pair of files
+    LOG_WARN("Ride log : %s file full\n", s->prefix);
+    return false;
+  }
+
+  return true;
+}
+
+static void ridelog_drain(void) {
+  uint32_t head = __atomic_load_n(&ridelog_trace_head, __ATOMIC_ACQUIRE);
+  while (ridelog_traces.open && (ridelog_trace_tail != head)) {
+    memcpy(ridelog_next(&ridelog_traces),
+      &ridelog_trace_ring[ridelog_trace_tail & (RIDELOG_TRACE_RING - 1)],
+      sizeof(ridelog_trace_record));
+    __atomic_store_n(&ridelog_trace_tail, ridelog_trace_tail + 1,
+                     __ATOMIC_RELEASE);
+
+    if (!ridelog_append(&ridelog_traces)) {
+      ridelog_close();
+    }
+  }
+}
+
+static void ridelog_sample(unsigned long now) {
+  ridelog_record *rec =
+    reinterpret_cast<ridelog_record*>(ridelog_next(&ridelog_ride));
+
+  float speed = control_get_speed();
+  float cadence = bluetooth_calculate_cadence();
+  int power = sensor_get_power();
+
+  rec->time = now;
+  rec->speed = static_cast<uint16_t>(constrain(speed * 100, 0, 65535));
+  rec->power = static_cast<int16_t>(constrain(power, -32768, 32767));
+  rec->cadence = static_cast<uint8_t>(constrain(cadence, 0, 255));
+  rec->op[0] = control_get_output(0);
+  rec->op[1] = control_get_output(1);
+  rec->source = sensor_get_source();
+  rec->mains_freq = static_cast<uint16_t>(get_mains_freq() * 100);
+  rec->override = 0;
+  for (int i = 0; i < CONTROL_NUM_FANS; i++) {
+    if (control_get_override(i) != CONTROL_AUTO) {
+      rec->override |= (1 << i);
+    }
+  }
+  rec->reserved = 0;
+
+  if (!ridelog_append(&ridelog_ride)) {
+    ridelog_close();
+  }
+}
+
+void ridelog_loop(void) {
+  if (USBDevice.mounted()) {
+    // Creating, removing and syncing files changes the FAT and directory
+    // under the host's cache (see file_persist()), so no session runs
+    // until the host is unplugged
+    ridelog_tracing = false;
+    ridelog_abandon_stream(&ridelog_ride);
+    ridelog_abandon_stream(&ridelog_traces);
+    return;
+  }
+
+  if (!config_get()->ridelog_enable || ridelog_failed) {
+    ridelog_close();
+    return;
+  }
+
+  // Notifications are kept as they come, not at the sample period
+  ridelog_drain();
+
+  unsigned long now = millis();
+  if ((now - ridelog_sample_millis) < config_get()->ridelog_period) {
+    return;
+  }
+  ridelog_sample_millis = now;
+
+  // A session runs while there is a speed source
+  if (sensor_get_source() != SENSOR_SOURCE_NONE) {
+    ridelog_active_millis = now;
+    if (!ridelog_ride.open && !ridelog_start()) {
+      ridelog_failed = true;
+      return;
+    }
+  } else if (ridelog_ride.open
+             && ((now - ridelog_active_millis) > RIDELOG_IDLE_TIMEOUT)) {
+    ridelog_close();
+  }
+
+  if (ridelog_ride.open) {
+    ridelog_sample(now);
+  }
+}
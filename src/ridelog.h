@@ -0,0 +1,109 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_RIDELOG_H_
+#define SRC_RIDELOG_H_
+
+#include <stdint.h>
+
+// Binary ride log. Each session is written to its own preallocated,
+// contiguous file (RIDEnnnn.BIN) one 4 kB flash sector at a time.
+// Every sector starts with a header followed by fixed size records,
+// see utils/ridelog.py for the host side converter. No session runs
+// while a USB host has the volume mounted.
+//
+// The files are not erased, so the clusters they get may still hold
+// valid sectors of an earlier, deleted session. Each session has a
+// random nonce written to every sector and readers stop at the first
+// sector with a different one.
+//
+// With ridelog.trace set the raw speed / cadence and power
+// notifications are also kept, with their arrival time, in TRACnnnn.BIN
+// alongside. The host replay program (src/native/replay.cpp) runs these
+// back through the parsers and the control loop.
+
+#define RIDELOG_SECTOR_SIZE     4096
+#define RIDELOG_MAGIC           0x4C525346  // "FSRL"
+#define RIDELOG_TRACE_MAGIC     0x54525346  // "FSRT"
+#define RIDELOG_VERSION         2
+#define RIDELOG_MAX_FILES       1000
+#define RIDELOG_IDLE_TIMEOUT    60000       // ms without a sensor
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t record_size;
+  uint16_t count;                   // Records in this sector
+  uint32_t sequence;                // Sector number in the session
+  uint32_t session;                 // Nonce, the same in every sector
+  uint32_t crc;                     // CRC32 of the header and records
+} ridelog_header;
+
+typedef struct __attribute__((packed)) {
+  uint32_t time;                    // millis()
+  uint16_t speed;                   // 0.01 mph
+  int16_t power;                    // W
+  uint8_t cadence;                  // rpm
+  uint8_t op[2];
+  uint8_t source;                   // SENSOR_SOURCE_*
+  uint16_t mains_freq;              // 0.01 Hz
+  uint8_t override;                 // Bit per fan
+  uint8_t reserved;
+} ridelog_record;
+
+#define RIDELOG_RECORDS \
+  ((RIDELOG_SECTOR_SIZE - sizeof(ridelog_header)) / sizeof(ridelog_record))
+
+#define RIDELOG_TRACE_CSC       1           // Speed and cadence
+#define RIDELOG_TRACE_CPS       2           // Cycling power
+#define RIDELOG_TRACE_DATA      26
+#define RIDELOG_TRACE_RING      32          // Must be a power of 2
+
+typedef struct __attribute__((packed)) {
+  uint32_t time;                    // micros() on arrival
+  uint8_t type;                     // RIDELOG_TRACE_*
+  uint8_t len;                      // Bytes of data, longer are cut
+  uint8_t data[RIDELOG_TRACE_DATA];
+} ridelog_trace_record;
+
+#define RIDELOG_TRACE_RECORDS \
+  ((RIDELOG_SECTOR_SIZE - sizeof(ridelog_header)) \
+   / sizeof(ridelog_trace_record))
+
+// Sector headers (ridelog_sector.cpp). The check returns zero for a
+// valid sector of the given sequence, and of the session if not NULL.
+void ridelog_sector_seal(uint8_t *sector, uint32_t magic,
+                         uint8_t record_size, uint16_t count,
+                         uint32_t sequence, uint32_t session);
+int ridelog_sector_check(const uint8_t *sector, uint32_t magic,
+                         uint8_t record_size, uint32_t sequence,
+                         const uint32_t *session);
+
+void ridelog_loop(void);
+void ridelog_close(void);
+bool ridelog_active(void);
+void ridelog_trace(uint8_t type, const uint8_t *data, uint16_t len);
+unsigned long ridelog_trace_dropped(void);
+
+#endif  // SRC_RIDELOG_H_
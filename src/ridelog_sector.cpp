@@ -0,0 +1,85 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <string.h>
+#include "crc.h"
+#include "ridelog.h"
+
+// Sector headers, shared by the writer in ridelog.cpp and the host
+// side readers
+
+static uint32_t ridelog_sector_crc(const uint8_t *sector, int len) {
+  // Header up to the CRC and the used records
+  uint32_t crc = crc32_update(CRC32_INIT, sector,
+    offsetof(ridelog_header, crc));
+  crc = crc32_update(crc, &sector[sizeof(ridelog_header)], len);
+  return ~crc;
+}
+
+void ridelog_sector_seal(uint8_t *sector, uint32_t magic,
+                         uint8_t record_size, uint16_t count,
+                         uint32_t sequence, uint32_t session) {
+  ridelog_header *header = reinterpret_cast<ridelog_header*>(sector);
+  header->magic = magic;
+  header->version = RIDELOG_VERSION;
+  header->record_size = record_size;
+  header->count = count;
+  header->sequence = sequence;
+  header->session = session;
+
+  // Unused records are erased so a partial sector is deterministic
+  int used = sizeof(ridelog_header) + (count * record_size);
+  memset(&sector[used], 0xFF, RIDELOG_SECTOR_SIZE - used);
+
+  header->crc = ridelog_sector_crc(sector, count * record_size);
+}
+
+int ridelog_sector_check(const uint8_t *sector, uint32_t magic,
+                         uint8_t record_size, uint32_t sequence,
+                         const uint32_t *session) {
+  const ridelog_header *header =
+    reinterpret_cast<const ridelog_header*>(sector);
+  if ((header->magic != magic) || (header->version != RIDELOG_VERSION)
+      || (header->record_size != record_size)
+      || (header->sequence != sequence)) {
+    return -1;
+  }
+
+  int records = (RIDELOG_SECTOR_SIZE - sizeof(ridelog_header)) / record_size;
+  if (header->count > records) {
+    return -2;
+  }
+
+  if (session && (header->session != *session)) {
+    // Left in the file's clusters by an earlier session
+    return -3;
+  }
+
+  if (ridelog_sector_crc(sector, header->count * record_size)
+      != header->crc) {
+    return -4;
+  }
+
+  return 0;
+}
@@ -0,0 +1,203 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "hal.h"
+#include "debug.h"
+#include "config.h"
+#include "bluetooth.h"
+#include "broadcast.h"
+#include "sensor.h"
+
+// Last sample pushed from the app. Only loop() reads or writes this.
+
+typedef struct {
+  uint8_t flags;
+  uint32_t timestamp;
+  unsigned long arrival;
+  unsigned long arrival_micros;
+  unsigned long ttl;
+  float speed;
+  int power;
+} virtual_sample;
+
+virtual_sample sensor_virtual = {0, 0, 0, 0, 0, 0, 0};
+bool sensor_virtual_new = false;
+bool sensor_uart_connected = false;
+int sensor_source = SENSOR_SOURCE_NONE;
+
+static bool sensor_virtual_valid(uint8_t flag) {
+  if (!(sensor_virtual.flags & flag)) {
+    return false;
+  }
+
+  return (hal_millis() - sensor_virtual.arrival) < sensor_virtual.ttl;
+}
+
+static bool sensor_virtual_expired(void) {
+  // Nothing stored, or the stored sample has timed out
+  return !sensor_virtual.flags
+    || ((hal_millis() - sensor_virtual.arrival) >= sensor_virtual.ttl);
+}
+
+static int sensor_select(void) {
+  // A follower uses the leader in place of its own physical sensor
+  int physical = SENSOR_SOURCE_NONE;
+  if (bluetooth_speed_valid()) {
+    physical = SENSOR_SOURCE_PHYSICAL;
+  } else if (broadcast_leader_valid()) {
+    physical = SENSOR_SOURCE_LEADER;
+  }
+  bool virt = sensor_virtual_valid(VIRTUAL_SPEED);
+
+  switch (config_get()->virtual_priority) {
+    case VIRTUAL_FALLBACK:
+      if (physical) return physical;
+      if (virt) return SENSOR_SOURCE_VIRTUAL;
+      break;
+    case VIRTUAL_PREFER:
+      if (virt) return SENSOR_SOURCE_VIRTUAL;
+      if (physical) return physical;
+      break;
+    case VIRTUAL_ONLY:
+      if (virt) return SENSOR_SOURCE_VIRTUAL;
+      break;
+    default:
+      if (physical) return physical;
+      break;
+  }
+
+  return SENSOR_SOURCE_NONE;
+}
+
+int sensor_virtual_update(uint8_t flags, uint32_t timestamp, float speed,
+                          int power, uint16_t ttl) {
+  if (config_get()->virtual_priority == VIRTUAL_OFF) {
+    return -1;
+  }
+
+  // Drop samples which arrive out of order. Once the stored one has
+  // expired anything goes, the app may have restarted its clock.
+  if (!sensor_virtual_expired()
+      && (static_cast<int32_t>(timestamp - sensor_virtual.timestamp) < 0)) {
+    DEBUG_PRINT("Dropped virtual sample %lu < %lu\n",
+      static_cast<unsigned long>(timestamp),
+      static_cast<unsigned long>(sensor_virtual.timestamp));
+    return -2;
+  }
+
+  if ((flags & VIRTUAL_SPEED) && (!isfinite(speed) || (speed < 0))) {
+    return -3;
+  }
+
+  sensor_virtual.flags = flags;
+  sensor_virtual.timestamp = timestamp;
+  sensor_virtual.arrival = hal_millis();
+  sensor_virtual.arrival_micros = hal_micros();
+  sensor_virtual.ttl = ttl ? ttl : config_get()->virtual_timeout;
+  sensor_virtual.speed = speed;
+  sensor_virtual.power = power;
+  sensor_virtual_new = true;
+
+  return 0;
+}
+
+void sensor_virtual_reset(void) {
+  sensor_virtual.flags = 0;
+  sensor_virtual.timestamp = 0;
+  sensor_virtual_new = false;
+}
+
+void sensor_loop(void) {
+  // The app may come back with a different clock, so forget its last
+  // sample when the UART link goes
+  bool connected = bluetooth_uart_connected();
+  if (sensor_uart_connected && !connected) {
+    DEBUG_COMMENT("Virtual sensor reset\n");
+    sensor_virtual_reset();
+  }
+  sensor_uart_connected = connected;
+}
+
+bool sensor_virtual_pending(void) {
+  // True if a new virtual sample should be applied straight away
+  if (!sensor_virtual_new) {
+    return false;
+  }
+  sensor_virtual_new = false;
+
+  return sensor_select() == SENSOR_SOURCE_VIRTUAL;
+}
+
+float sensor_get_speed(void) {
+  int source = sensor_select();
+  if (source != sensor_source) {
+    DEBUG_PRINT("Speed source %d -> %d\n", sensor_source, source);
+    sensor_source = source;
+  }
+
+  switch (source) {
+    case SENSOR_SOURCE_PHYSICAL:
+      return bluetooth_calculate_speed();
+    case SENSOR_SOURCE_VIRTUAL:
+      return sensor_virtual.speed;
+    case SENSOR_SOURCE_LEADER:
+      return broadcast_leader_speed();
+    default:
+      return 0.0;
+  }
+}
+
+int sensor_get_power(void) {
+  uint8_t priority = config_get()->virtual_priority;
+  if ((priority != VIRTUAL_OFF) && sensor_virtual_valid(VIRTUAL_POWER)) {
+    if ((priority != VIRTUAL_FALLBACK)
+        || !bluetooth_get_power()) {
+      return sensor_virtual.power;
+    }
+  }
+
+  if (!bluetooth_get_power() && broadcast_leader_valid()) {
+    return broadcast_leader_power();
+  }
+
+  return bluetooth_get_power();
+}
+
+unsigned long sensor_get_stamp(void) {
+  // Arrival time (micros) of the sample behind sensor_get_speed()
+  switch (sensor_source) {
+    case SENSOR_SOURCE_PHYSICAL:
+      return bluetooth_speed_stamp();
+    case SENSOR_SOURCE_VIRTUAL:
+      return sensor_virtual.arrival_micros;
+    case SENSOR_SOURCE_LEADER:
+      return broadcast_leader_stamp();
+    default:
+      return 0;
+  }
+}
+
+int sensor_get_source(void) {
+  return sensor_source;
+}
@@ -0,0 +1,59 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_SENSOR_H_
+#define SRC_SENSOR_H_
+
+#include <stdint.h>
+
+// Where the speed used by the control loop comes from
+
+#define SENSOR_SOURCE_NONE      0
+#define SENSOR_SOURCE_PHYSICAL  1
+#define SENSOR_SOURCE_VIRTUAL   2
+#define SENSOR_SOURCE_LEADER    3     // Broadcast from another controller
+
+// Priority of the virtual sensor relative to the physical one
+
+#define VIRTUAL_OFF             0     // Physical sensor only
+#define VIRTUAL_FALLBACK        1     // Virtual when physical is invalid
+#define VIRTUAL_PREFER          2     // Physical when virtual is stale
+#define VIRTUAL_ONLY            3     // Virtual sensor only
+
+// Flags of a virtual sample
+
+#define VIRTUAL_SPEED           0x01
+#define VIRTUAL_POWER           0x02
+
+int sensor_virtual_update(uint8_t flags, uint32_t timestamp, float speed,
+                          int power, uint16_t ttl);
+void sensor_virtual_reset(void);
+void sensor_loop(void);
+bool sensor_virtual_pending(void);
+float sensor_get_speed(void);
+int sensor_get_power(void);
+int sensor_get_source(void);
+unsigned long sensor_get_stamp(void);
+
+#endif  // SRC_SENSOR_H_
@@ -0,0 +1,196 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "hal.h"
+#include "debug.h"
+#include "bluetooth.h"
+#include "control.h"
+#include "triac.h"
+#include "uart_cmd.h"
+#include "sensor.h"
+#include "telemetry.h"
+
+int telemetry_rate = 0;
+unsigned long telemetry_sample_millis = 0;
+uint8_t telemetry_seq = 0;
+
+// Frame being built
+
+uint8_t telemetry_buffer[CMD_MAX_PAYLOAD];
+int telemetry_len = 0;
+int telemetry_count = 0;
+unsigned long telemetry_frame_millis = 0;
+unsigned long telemetry_last_millis = 0;
+int32_t telemetry_last[TELEMETRY_NUM_FIELDS];
+
+static int telemetry_put_varint(uint8_t *buf, uint32_t val) {
+  int n = 0;
+  while (val >= 0x80) {
+    buf[n++] = (val & 0x7F) | 0x80;
+    val >>= 7;
+  }
+  buf[n++] = val;
+  return n;
+}
+
+static inline uint32_t telemetry_zigzag(int32_t val) {
+  return (static_cast<uint32_t>(val) << 1)
+    ^ static_cast<uint32_t>(val >> 31);
+}
+
+static int32_t telemetry_fixed(float val) {
+  // In 0.01 units, NaN and out of range values would overflow the cast
+  if (!(val > -TELEMETRY_FIXED_MAX / 100)) {
+    return val < 0 ? -TELEMETRY_FIXED_MAX : 0;
+  }
+  if (val > TELEMETRY_FIXED_MAX / 100) {
+    return TELEMETRY_FIXED_MAX;
+  }
+
+  return static_cast<int32_t>(val * 100);
+}
+
+static void telemetry_sample(int32_t *sample) {
+  sample[TELEMETRY_SPEED] = telemetry_fixed(control_get_speed());
+  sample[TELEMETRY_POWER] = sensor_get_power();
+  sample[TELEMETRY_OP1] = control_get_output(0);
+  sample[TELEMETRY_OP2] = control_get_output(1);
+  sample[TELEMETRY_MAINS_FREQ] = telemetry_fixed(get_mains_freq());
+  sample[TELEMETRY_CONNECTIONS] = bluetooth_get_connections();
+
+  int override = 0;
+  for (int i = 0; i < CONTROL_NUM_FANS; i++) {
+    if (control_get_override(i) != CONTROL_AUTO) {
+      override |= (1 << i);
+    }
+  }
+  sample[TELEMETRY_OVERRIDE] = override;
+  sample[TELEMETRY_SOURCE] = sensor_get_source();
+}
+
+static int telemetry_frame_size(void) {
+  // Keep each frame within one notification, a key sample alone can be
+  // larger at the default MTU (see telemetry.h)
+  int size = bluetooth_uart_mtu() - CMD_HEADER_LEN - CMD_CRC_LEN;
+  if (size > CMD_MAX_PAYLOAD) {
+    size = CMD_MAX_PAYLOAD;
+  }
+
+  return size;
+}
+
+static void telemetry_flush(void) {
+  if (!telemetry_count) {
+    return;
+  }
+
+  telemetry_buffer[1] = telemetry_count;
+  uart_cmd_send(CMD_TELEMETRY_DATA, telemetry_seq++,
+    telemetry_buffer, telemetry_len);
+
+  telemetry_len = 0;
+  telemetry_count = 0;
+}
+
+static void telemetry_add(unsigned long now, const int32_t *sample) {
+  if (telemetry_count
+      && ((telemetry_len + TELEMETRY_MAX_SAMPLE) > telemetry_frame_size())) {
+    telemetry_flush();
+  }
+
+  uint8_t *buf = telemetry_buffer;
+  if (!telemetry_count) {
+    // Start a new frame with a key sample
+    buf[0] = TELEMETRY_VERSION;
+    buf[1] = 0;
+    buf[2] = now & 0xFF;
+    buf[3] = (now >> 8) & 0xFF;
+    buf[4] = (now >> 16) & 0xFF;
+    buf[5] = (now >> 24) & 0xFF;
+    telemetry_len = TELEMETRY_HEADER_LEN;
+    for (int i = 0; i < TELEMETRY_NUM_FIELDS; i++) {
+      telemetry_len += telemetry_put_varint(&buf[telemetry_len],
+        telemetry_zigzag(sample[i]));
+    }
+    telemetry_frame_millis = now;
+  } else {
+    telemetry_len += telemetry_put_varint(&buf[telemetry_len],
+      now - telemetry_last_millis);
+    int mask_pos = telemetry_len++;
+    uint8_t mask = 0;
+    for (int i = 0; i < TELEMETRY_NUM_FIELDS; i++) {
+      // Modulo 2^32, the receiver adds it back the same way
+      uint32_t delta = static_cast<uint32_t>(sample[i])
+        - static_cast<uint32_t>(telemetry_last[i]);
+      if (delta) {
+        mask |= (1 << i);
+        telemetry_len += telemetry_put_varint(&buf[telemetry_len],
+          telemetry_zigzag(static_cast<int32_t>(delta)));
+      }
+    }
+    buf[mask_pos] = mask;
+  }
+
+  memcpy(telemetry_last, sample, sizeof(telemetry_last));
+  telemetry_last_millis = now;
+  telemetry_count++;
+}
+
+int telemetry_subscribe(int rate) {
+  if (rate && ((rate < TELEMETRY_RATE_MIN) || (rate > TELEMETRY_RATE_MAX))) {
+    return -127;
+  }
+
+  DEBUG_PRINT("Telemetry rate = %d Hz\n", rate);
+  telemetry_rate = rate;
+  telemetry_len = 0;
+  telemetry_count = 0;
+  return 0;
+}
+
+void telemetry_loop(void) {
+  if (!telemetry_rate) {
+    return;
+  }
+
+  if (!bluetooth_uart_connected()) {
+    // Client has gone, they must subscribe again
+    telemetry_subscribe(0);
+    return;
+  }
+
+  unsigned long now = hal_millis();
+  if ((now - telemetry_sample_millis) < (1000UL / telemetry_rate)) {
+    return;
+  }
+  telemetry_sample_millis = now;
+
+  int32_t sample[TELEMETRY_NUM_FIELDS];
+  telemetry_sample(sample);
+  telemetry_add(now, sample);
+
+  if ((now - telemetry_frame_millis) >= TELEMETRY_MAX_LATENCY) {
+    telemetry_flush();
+  }
+}
@@ -0,0 +1,68 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef SRC_TELEMETRY_H_
+#define SRC_TELEMETRY_H_
+
+#include <stdint.h>
+
+// Telemetry is sent as CMD_TELEMETRY_DATA frames on the BLE UART with
+// the frame counter as seq. Each frame holds several samples:
+//
+//   | u8 version | u8 count | u32 time (ms) | key sample | delta samples |
+//
+// The key sample is every field as a zigzag varint. Each delta sample
+// is a varint of the ms since the previous sample, a u8 mask of the
+// fields which changed and a zigzag varint delta for each of those.
+//
+// Frames are sized to fit one notification, but a frame always holds at
+// least the key sample. At the default ATT MTU (20 byte notifications)
+// that is more than the 14 bytes left after the command header and CRC,
+// so each frame carries a single sample and the BLE UART splits it over
+// two notifications. Clients should ask for a larger MTU.
+
+#define TELEMETRY_VERSION       1
+#define TELEMETRY_RATE_MIN      1
+#define TELEMETRY_RATE_MAX      20
+#define TELEMETRY_MAX_LATENCY   1000  // ms before a partial frame is sent
+#define TELEMETRY_HEADER_LEN    6
+#define TELEMETRY_MAX_SAMPLE    (3 + 1 + (TELEMETRY_NUM_FIELDS * 5))
+#define TELEMETRY_FIXED_MAX     1000000   // Clamp of 0.01 unit fields
+
+// Fields of each sample
+
+#define TELEMETRY_SPEED         0     // 0.01 mph
+#define TELEMETRY_POWER         1     // W
+#define TELEMETRY_OP1           2
+#define TELEMETRY_OP2           3
+#define TELEMETRY_MAINS_FREQ    4     // 0.01 Hz
+#define TELEMETRY_CONNECTIONS   5     // bluetooth_get_connections()
+#define TELEMETRY_OVERRIDE      6     // Bit per fan under manual control
+#define TELEMETRY_SOURCE        7     // SENSOR_SOURCE_* in sensor.h
+#define TELEMETRY_NUM_FIELDS    8
+
+int telemetry_subscribe(int rate);
+void telemetry_loop(void);
+
+#endif  // SRC_TELEMETRY_H_
@@ -22,14 +22,13 @@
 // SOFTWARE.
 //
 
-#include <Arduino.h>
-#include "inttimer.h"
+#include "hal.h"
 #include "wiring.h"
 #include "debug.h"
 #include "triac.h"
 #include "config.h"
-
-TimerClass triac_inttimer(2);
+#include "profile.h"
+#include "latency.h"
 
 volatile int zero_cross_clock = 0;
 unsigned long zero_cross_last_clock = 0;
@@ -43,54 +42,86 @@ unsigned long zero_cross_pulse1 = 0;
 unsigned long zero_cross_pulse2 = 0;
 unsigned long zero_cross_positive = 0;
 unsigned long zero_cross_negative = 0;
+float mains_freq = 0;
+
+// Latency tracing of a new delay, set is zero when nothing is pending
+volatile unsigned long fan_trace_stamp[2] = {0, 0};
+volatile unsigned long fan_trace_set[2] = {0, 0};
+unsigned long fan_trace_last = 0;   // Last sensor stamp traced
+
+static inline void triac_trace(int fan) {
+  // Called from the timer when a delay takes effect
+  if (fan_trace_set[fan]) {
+    latency_fire(fan_trace_stamp[fan], fan_trace_set[fan], hal_micros());
+    fan_trace_set[fan] = 0;
+  }
+}
 
 void zero_crossing_isr(void) {
-  if (!digitalRead(PIN_MAINS_CLOCK)) {
+  PROFILE_START();
+
+  if (!hal_pin_read(PIN_MAINS_CLOCK)) {
     zero_cross_clock++;
     zero_cross_trigger_1 = true;
     zero_cross_trigger_2 = true;
-    zero_cross_micros = micros();
-    zero_cross_negative = micros();
-    zero_cross_pulse2 = micros() - zero_cross_positive;
+    zero_cross_micros = hal_micros();
+    zero_cross_negative = hal_micros();
+    zero_cross_pulse2 = hal_micros() - zero_cross_positive;
   } else {
-    zero_cross_positive = micros();
-    zero_cross_pulse1 = micros() - zero_cross_negative;
+    zero_cross_positive = hal_micros();
+    zero_cross_pulse1 = hal_micros() - zero_cross_negative;
   }
+
+  PROFILE_END(PROFILE_ZERO_CROSS);
 }
 
-void hardtimer_callback(void* ptr) {
-  (void) ptr;
+void hardtimer_callback(void) {
+  PROFILE_START();
 
   if (fan1_delay > 0) {
     if (zero_cross_trigger_1) {
-      if ((micros() - zero_cross_micros) > fan1_delay) {
-        digitalWrite(PIN_FAN_1, HIGH);
-        delayMicroseconds(50);
-        digitalWrite(PIN_FAN_1, LOW);
+      if ((hal_micros() - zero_cross_micros) > fan1_delay) {
+        hal_pin_write(PIN_FAN_1, true);
+        triac_trace(0);
+        hal_delay_us(50);
+        hal_pin_write(PIN_FAN_1, false);
         zero_cross_trigger_1 = false;
       }
     }
   } else {
+    if (zero_cross_trigger_1) {
+      // Off takes effect at the first half cycle without a pulse
+      triac_trace(0);
+    }
     zero_cross_trigger_1 = false;
   }
 
   if (fan2_delay > 0) {
     if (zero_cross_trigger_2) {
-      if ((micros() - zero_cross_micros) > fan2_delay) {
-        digitalWrite(PIN_FAN_2, HIGH);
-        delayMicroseconds(50);
-        digitalWrite(PIN_FAN_2, LOW);
+      if ((hal_micros() - zero_cross_micros) > fan2_delay) {
+        hal_pin_write(PIN_FAN_2, true);
+        triac_trace(1);
+        hal_delay_us(50);
+        hal_pin_write(PIN_FAN_2, false);
         zero_cross_trigger_2 = false;
       }
     }
+  } else if (zero_cross_trigger_2) {
+    triac_trace(1);
   }
 
   hardtimer_count++;
+
+  PROFILE_END(PROFILE_HARDTIMER);
 }
 
+// Fan poll on CC0, cleared in hardware so the period does not drift
+typedef InterruptTimer<2, hardtimer_callback> TriacTimer;
+INTTIMER_IRQ_HANDLER(2, TriacTimer)
+
 float calc_mains_freq(void) {
   float _freq = zero_cross_clock;
-  float _diff = (static_cast<float>(millis())
+  float _diff = (static_cast<float>(hal_millis())
     - static_cast<float>(zero_cross_last_clock));
   if (_diff == 0) {
     return 0;
@@ -100,39 +131,67 @@ float calc_mains_freq(void) {
   _freq /= _diff;
   _freq *= 500;  // Convert to seconds (and 2 per cycle)
 
-  zero_cross_last_clock = millis();
+  zero_cross_last_clock = hal_millis();
   zero_cross_clock = 0;
+  mains_freq = _freq;
 
   return _freq;
 }
 
+float get_mains_freq(void) {
+  // Last value from calc_mains_freq()
+  return mains_freq;
+}
+
 void triac_setup(void) {
-  triac_inttimer.setCallback(hardtimer_callback);
-  triac_inttimer.init(5);
-  triac_inttimer.start();
-  attachInterrupt(digitalPinToInterrupt(PIN_MAINS_CLOCK),
-    zero_crossing_isr, CHANGE);
+  TriacTimer::begin();
+  TriacTimer::setPeriodic(0, TRIAC_TIMER_PERIOD);
+  TriacTimer::start();
+  hal_attach_isr(PIN_MAINS_CLOCK, zero_crossing_isr);
 }
 
-void triac_set_output(uint8_t op1, uint8_t op2) {
+unsigned long triac_calc_delay(const config_data *data, uint8_t op) {
   // Here we map the OP to values
   // 1 = full on, 6000 = full off
-  if (op1 == 0) {
-    fan1_delay = 0;
-  } else {
-    fan1_delay = config.triac_off_delay - (config.triac_off_delay * op1 / 255L);
-    if (fan1_delay == 0) {
-      fan1_delay = config.triac_on_delay;
-    }
+  if (op == 0) {
+    return 0;
   }
 
-  if (op2 == 0) {
-    fan2_delay = 0;
-  } else {
-    fan2_delay = config.triac_off_delay - (config.triac_off_delay * op2 / 255L);
-    if (fan2_delay == 0) {
-      fan2_delay = config.triac_on_delay;
-    }
+  unsigned long delay = data->triac_off_delay
+    - (data->triac_off_delay * op / 255L);
+  if (delay == 0) {
+    delay = data->triac_on_delay;
+  }
+
+  return delay;
+}
+
+void triac_set_output(uint8_t op1, uint8_t op2, unsigned long stamp) {
+  unsigned long now = hal_micros();
+  if (stamp == fan_trace_last) {
+    // Periodic updates, off timer and profile changes pass the stamp of
+    // a sample which has already been traced
+    stamp = 0;
+  } else if (stamp) {
+    fan_trace_last = stamp;
+    latency_control(stamp, now);
+  }
+  now |= 1;  // Zero means no trace pending
+
+  // Phase table is built with the config it belongs to
+  const config_live *live = config_get_live();
+  unsigned long delay1 = live->triac_delay[op1];
+  if (delay1 != fan1_delay) {
+    fan_trace_stamp[0] = stamp;
+    fan_trace_set[0] = now;
+    fan1_delay = delay1;
+  }
+
+  unsigned long delay2 = live->triac_delay[op2];
+  if (delay2 != fan2_delay) {
+    fan_trace_stamp[1] = stamp;
+    fan_trace_set[1] = now;
+    fan2_delay = delay2;
   }
 
   DEBUG_PRINT("op1 = %d, op2 = %d\n", op1, op2);
@@ -25,12 +25,18 @@
 #ifndef SRC_TRIAC_H_
 #define SRC_TRIAC_H_
 
+#include "config.h"
+
+#define TRIAC_TIMER_PERIOD    5  // uS between polls of the fan delays
+
 extern unsigned long zero_cross_pulse1;
 extern unsigned long zero_cross_pulse2;
 extern unsigned long hardtimer_count;
 
 void triac_setup(void);
 float calc_mains_freq(void);
-void triac_set_output(uint8_t op1, uint8_t op2);
+float get_mains_freq(void);
+unsigned long triac_calc_delay(const config_data *data, uint8_t op);
+void triac_set_output(uint8_t op1, uint8_t op2, unsigned long stamp = 0);
 
 #endif  // SRC_TRIAC_H_
@@ -0,0 +1,525 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "hal.h"
+#include "debug.h"
+#include "config.h"
+#include "crc.h"
+#include "bluetooth.h"
+#include "control.h"
+#include "telemetry.h"
+#include "sensor.h"
+#include "profile.h"
+#include "latency.h"
+#include "uart_cmd.h"
+
+// Ring buffer of received bytes. Only loop() reads from the UART into
+// the ring and parses from it so no locking is needed.
+
+uint8_t cmd_ring[CMD_RING_SIZE];
+uint16_t cmd_ring_head = 0;
+uint16_t cmd_ring_tail = 0;
+volatile bool cmd_rx_pending = false;
+
+uint8_t cmd_tx_buffer[CMD_HEADER_LEN + CMD_MAX_PAYLOAD + CMD_CRC_LEN];
+
+unsigned long cmd_crc_errors = 0;
+
+static inline uint8_t cmd_ring_at(uint16_t i) {
+  return cmd_ring[i & (CMD_RING_SIZE - 1)];
+}
+
+static inline uint16_t cmd_ring_used(void) {
+  return cmd_ring_head - cmd_ring_tail;
+}
+
+void uart_cmd_rx_callback(uint16_t conn_handle, void* ctx) {
+  (void) conn_handle;
+  (void) ctx;
+
+  // Data is read from the UART in loop()
+  cmd_rx_pending = true;
+}
+
+void uart_cmd_fill(void) {
+  // Read directly into the free space of the ring
+  cmd_rx_pending = false;
+  while (cmd_ring_used() < CMD_RING_SIZE) {
+    uint16_t idx = cmd_ring_head & (CMD_RING_SIZE - 1);
+    uint16_t len = CMD_RING_SIZE - idx;
+    uint16_t free = CMD_RING_SIZE - cmd_ring_used();
+    if (len > free) {
+      len = free;
+    }
+
+    int n = bluetooth_uart_read(&cmd_ring[idx], len);
+    if (n <= 0) {
+      return;
+    }
+    cmd_ring_head += n;
+  }
+
+  // Ring is full, leave the rest in the UART fifo
+  cmd_rx_pending = true;
+}
+
+uint8_t uart_cmd_get_u8(const uart_cmd_frame *frame, int i) {
+  if (i >= frame->len) {
+    return 0;
+  }
+  return cmd_ring_at(frame->offset + i);
+}
+
+uint16_t uart_cmd_get_u16(const uart_cmd_frame *frame, int i) {
+  return uart_cmd_get_u8(frame, i)
+    | (uart_cmd_get_u8(frame, i + 1) << 8);
+}
+
+uint32_t uart_cmd_get_u32(const uart_cmd_frame *frame, int i) {
+  return uart_cmd_get_u16(frame, i)
+    | (static_cast<uint32_t>(uart_cmd_get_u16(frame, i + 2)) << 16);
+}
+
+float uart_cmd_get_float(const uart_cmd_frame *frame, int i) {
+  uint32_t raw = uart_cmd_get_u32(frame, i);
+  float val;
+  memcpy(&val, &raw, sizeof(val));
+  return val;
+}
+
+int uart_cmd_send(uint8_t opcode, uint8_t seq,
+                  const uint8_t *data, int len) {
+  if (len > CMD_MAX_PAYLOAD) {
+    return -127;
+  }
+
+  cmd_tx_buffer[0] = CMD_SYNC;
+  cmd_tx_buffer[1] = opcode;
+  cmd_tx_buffer[2] = seq;
+  cmd_tx_buffer[3] = len;
+  if (len) {
+    memcpy(&cmd_tx_buffer[CMD_HEADER_LEN], data, len);
+  }
+
+  uint16_t crc = crc16(&cmd_tx_buffer[1], CMD_HEADER_LEN - 1 + len);
+  cmd_tx_buffer[CMD_HEADER_LEN + len] = crc & 0xFF;
+  cmd_tx_buffer[CMD_HEADER_LEN + len + 1] = crc >> 8;
+
+  return bluetooth_uart_write(cmd_tx_buffer,
+    CMD_HEADER_LEN + len + CMD_CRC_LEN);
+}
+
+int uart_cmd_reply(const uart_cmd_frame *frame, uint8_t status,
+                   const uint8_t *data, int len) {
+  uint8_t payload[CMD_MAX_PAYLOAD];
+  if (len >= CMD_MAX_PAYLOAD) {
+    return -127;
+  }
+
+  payload[0] = status;
+  if (len) {
+    memcpy(&payload[1], data, len);
+  }
+
+  return uart_cmd_send(frame->opcode | CMD_REPLY, frame->seq, payload,
+    len + 1);
+}
+
+static int cmd_fan_override(const uart_cmd_frame *frame) {
+  if (frame->len != 3) {
+    return CMD_ERR_LENGTH;
+  }
+
+  int fan = uart_cmd_get_u8(frame, 0);
+  int level = static_cast<int16_t>(uart_cmd_get_u16(frame, 1));
+  if ((fan >= CONTROL_NUM_FANS) || (level < CONTROL_AUTO) || (level > 255)) {
+    return CMD_ERR_VALUE;
+  }
+
+  control_set_override(fan, level);
+  control_apply();
+  return CMD_OK;
+}
+
+static int cmd_curve_set(const uart_cmd_frame *frame) {
+  if (frame->len != 12) {
+    return CMD_ERR_LENGTH;
+  }
+
+  float speed_min = uart_cmd_get_float(frame, 0);
+  float speed_max = uart_cmd_get_float(frame, 4);
+  float speed_threshold = uart_cmd_get_float(frame, 8);
+  if (!(speed_min < speed_max) || !(speed_threshold <= speed_min)
+      || !(speed_threshold >= 0)) {
+    return CMD_ERR_VALUE;
+  }
+
+  config_data data = *config_get();
+  data.speed_min = speed_min;
+  data.speed_max = speed_max;
+  data.speed_threshold = speed_threshold;
+  if (config_validate(&data)) {
+    return CMD_ERR_VALUE;
+  }
+
+  config_publish(&data);
+  return CMD_OK;
+}
+
+static void cmd_put_float(uint8_t *buf, float val) {
+  memcpy(buf, &val, sizeof(val));
+}
+
+static void cmd_put_u32(uint8_t *buf, uint32_t val) {
+  buf[0] = val & 0xFF;
+  buf[1] = (val >> 8) & 0xFF;
+  buf[2] = (val >> 16) & 0xFF;
+  buf[3] = (val >> 24) & 0xFF;
+}
+
+static int cmd_curve_get(uint8_t *buf) {
+  const config_data *cfg = config_get();
+  cmd_put_float(&buf[0], cfg->speed_min);
+  cmd_put_float(&buf[4], cfg->speed_max);
+  cmd_put_float(&buf[8], cfg->speed_threshold);
+  return 12;
+}
+
+static int cmd_config_set(const uart_cmd_frame *frame) {
+  if (frame->len < 1) {
+    return CMD_ERR_LENGTH;
+  }
+
+  // Edit a copy and publish it as a whole
+  config_data data = *config_get();
+  int len = frame->len - 1;
+  switch (uart_cmd_get_u8(frame, 0)) {
+    case CMD_KEY_SPEED_MAX:
+      if (len != 4) return CMD_ERR_LENGTH;
+      if (!(uart_cmd_get_float(frame, 1) > data.speed_min)) {
+        return CMD_ERR_VALUE;
+      }
+      data.speed_max = uart_cmd_get_float(frame, 1);
+      break;
+    case CMD_KEY_SPEED_MIN:
+      if (len != 4) return CMD_ERR_LENGTH;
+      if (!(uart_cmd_get_float(frame, 1) < data.speed_max)) {
+        return CMD_ERR_VALUE;
+      }
+      data.speed_min = uart_cmd_get_float(frame, 1);
+      break;
+    case CMD_KEY_SPEED_THRESHOLD:
+      if (len != 4) return CMD_ERR_LENGTH;
+      if (!(uart_cmd_get_float(frame, 1) >= 0)) {
+        return CMD_ERR_VALUE;
+      }
+      data.speed_threshold = uart_cmd_get_float(frame, 1);
+      break;
+    case CMD_KEY_TRIAC_OFF_DELAY:
+      if (len != 4) return CMD_ERR_LENGTH;
+      data.triac_off_delay = uart_cmd_get_u32(frame, 1);
+      break;
+    case CMD_KEY_TRIAC_ON_DELAY:
+      if (len != 4) return CMD_ERR_LENGTH;
+      data.triac_on_delay = uart_cmd_get_u32(frame, 1);
+      break;
+    case CMD_KEY_SPEED_SENSOR_ID:
+      if (len != 6) return CMD_ERR_LENGTH;
+      for (int i = 0; i < 6; i++) {
+        data.bt_speed_sensor_id[i] = uart_cmd_get_u8(frame, i + 1);
+      }
+      break;
+    case CMD_KEY_POWER_SENSOR_ID:
+      if (len != 6) return CMD_ERR_LENGTH;
+      for (int i = 0; i < 6; i++) {
+        data.bt_power_sensor_id[i] = uart_cmd_get_u8(frame, i + 1);
+      }
+      break;
+    default:
+      return CMD_ERR_KEY;
+  }
+
+  if (config_validate(&data)) {
+    return CMD_ERR_VALUE;
+  }
+  config_publish(&data);
+
+  return CMD_OK;
+}
+
+static int cmd_fan_profile_set(const uart_cmd_frame *frame) {
+  // Applied from loop() when it sees the new config
+  if (frame->len != 1) {
+    return CMD_ERR_LENGTH;
+  }
+
+  if (config_profile_select(uart_cmd_get_u8(frame, 0))) {
+    return CMD_ERR_VALUE;
+  }
+
+  return CMD_OK;
+}
+
+static int cmd_fan_profile_get(const uart_cmd_frame *frame, uint8_t *buf,
+                               int *len) {
+  // Reply with u8 selected, u8 count and the name of the profile
+  if (frame->len > 1) {
+    return CMD_ERR_LENGTH;
+  }
+
+  int index = frame->len ? uart_cmd_get_u8(frame, 0) : config_profile_get();
+  const config_data *data = config_profile_data(index);
+  if (!data) {
+    return CMD_ERR_VALUE;
+  }
+
+  buf[0] = config_profile_get();
+  buf[1] = config_profile_count();
+  *len = 2 + strnlen(data->name, CONFIG_NAME_LEN);
+  memcpy(&buf[2], data->name, *len - 2);
+
+  return CMD_OK;
+}
+
+static int cmd_config_get(const uart_cmd_frame *frame, uint8_t *buf,
+                          int *len) {
+  if (frame->len != 1) {
+    return CMD_ERR_LENGTH;
+  }
+
+  const config_data *cfg = config_get();
+  *len = 4;
+  switch (uart_cmd_get_u8(frame, 0)) {
+    case CMD_KEY_SPEED_MAX:
+      cmd_put_float(buf, cfg->speed_max);
+      break;
+    case CMD_KEY_SPEED_MIN:
+      cmd_put_float(buf, cfg->speed_min);
+      break;
+    case CMD_KEY_SPEED_THRESHOLD:
+      cmd_put_float(buf, cfg->speed_threshold);
+      break;
+    case CMD_KEY_TRIAC_OFF_DELAY:
+      cmd_put_u32(buf, cfg->triac_off_delay);
+      break;
+    case CMD_KEY_TRIAC_ON_DELAY:
+      cmd_put_u32(buf, cfg->triac_on_delay);
+      break;
+    case CMD_KEY_SPEED_SENSOR_ID:
+      memcpy(buf, cfg->bt_speed_sensor_id, 6);
+      *len = 6;
+      break;
+    case CMD_KEY_POWER_SENSOR_ID:
+      memcpy(buf, cfg->bt_power_sensor_id, 6);
+      *len = 6;
+      break;
+    default:
+      *len = 0;
+      return CMD_ERR_KEY;
+  }
+
+  return CMD_OK;
+}
+
+static int cmd_telemetry(const uart_cmd_frame *frame) {
+  if (frame->len != 1) {
+    return CMD_ERR_LENGTH;
+  }
+
+  if (telemetry_subscribe(uart_cmd_get_u8(frame, 0))) {
+    return CMD_ERR_VALUE;
+  }
+  return CMD_OK;
+}
+
+static int cmd_virtual_sensor(const uart_cmd_frame *frame) {
+  if (frame->len != 13) {
+    return CMD_ERR_LENGTH;
+  }
+
+  if (sensor_virtual_update(uart_cmd_get_u8(frame, 0),
+      uart_cmd_get_u32(frame, 1), uart_cmd_get_float(frame, 5),
+      static_cast<int16_t>(uart_cmd_get_u16(frame, 9)),
+      uart_cmd_get_u16(frame, 11))) {
+    return CMD_ERR_VALUE;
+  }
+
+  return CMD_OK;
+}
+
+#ifdef PROFILE_TIMING
+static int cmd_profile(const uart_cmd_frame *frame, uint8_t *buf, int *len) {
+  // Reply with u32 count, min, max and mean in cycles followed by the
+  // log2 histogram as saturated u16s
+  if ((frame->len < 1) || (frame->len > 2)) {
+    return CMD_ERR_LENGTH;
+  }
+
+  int site = uart_cmd_get_u8(frame, 0);
+  const histogram *s = profile_get(site);
+  if (!s) {
+    return CMD_ERR_VALUE;
+  }
+
+  *len = histogram_pack(buf, s);
+
+  if (uart_cmd_get_u8(frame, 1)) {
+    profile_reset(site);
+  }
+
+  return CMD_OK;
+}
+#endif
+
+static int cmd_latency(const uart_cmd_frame *frame, uint8_t *buf, int *len) {
+  // Reply with the histogram (in us) and the number of SLO misses
+  if ((frame->len < 1) || (frame->len > 2)) {
+    return CMD_ERR_LENGTH;
+  }
+
+  const histogram *h = latency_get(uart_cmd_get_u8(frame, 0));
+  if (!h) {
+    return CMD_ERR_VALUE;
+  }
+
+  *len = histogram_pack(buf, h);
+  cmd_put_u32(&buf[*len], latency_slo_misses());
+  *len += 4;
+
+  if (uart_cmd_get_u8(frame, 1)) {
+    latency_reset();
+  }
+
+  return CMD_OK;
+}
+
+void uart_cmd_process(const uart_cmd_frame *frame) {
+  uint8_t data[CMD_MAX_PAYLOAD - 1];
+  int len = 0;
+  int status;
+
+  switch (frame->opcode) {
+    case CMD_PING:
+      status = CMD_OK;
+      break;
+    case CMD_FAN_OVERRIDE:
+      status = cmd_fan_override(frame);
+      break;
+    case CMD_CURVE_SET:
+      status = cmd_curve_set(frame);
+      break;
+    case CMD_CURVE_GET:
+      len = cmd_curve_get(data);
+      status = CMD_OK;
+      break;
+    case CMD_FAN_PROFILE_SET:
+      status = cmd_fan_profile_set(frame);
+      break;
+    case CMD_FAN_PROFILE_GET:
+      status = cmd_fan_profile_get(frame, data, &len);
+      break;
+    case CMD_CONFIG_SET:
+      status = cmd_config_set(frame);
+      break;
+    case CMD_CONFIG_GET:
+      status = cmd_config_get(frame, data, &len);
+      break;
+    case CMD_TELEMETRY:
+      status = cmd_telemetry(frame);
+      break;
+    case CMD_VIRTUAL_SENSOR:
+      status = cmd_virtual_sensor(frame);
+      break;
+    case CMD_LATENCY:
+      status = cmd_latency(frame, data, &len);
+      break;
+#ifdef PROFILE_TIMING
+    case CMD_PROFILE:
+      status = cmd_profile(frame, data, &len);
+      break;
+#endif
+    default:
+      status = CMD_ERR_OPCODE;
+      break;
+  }
+
+  uart_cmd_reply(frame, status, data, len);
+}
+
+void uart_cmd_parse(void) {
+  // Parse as many complete frames as are in the ring
+  while (cmd_ring_used() >= (CMD_HEADER_LEN + CMD_CRC_LEN)) {
+    if (cmd_ring_at(cmd_ring_tail) != CMD_SYNC) {
+      cmd_ring_tail++;
+      continue;
+    }
+
+    uart_cmd_frame frame;
+    frame.opcode = cmd_ring_at(cmd_ring_tail + 1);
+    frame.seq = cmd_ring_at(cmd_ring_tail + 2);
+    frame.len = cmd_ring_at(cmd_ring_tail + 3);
+    frame.offset = cmd_ring_tail + CMD_HEADER_LEN;
+
+    if (frame.len > CMD_MAX_PAYLOAD) {
+      // Not a valid header, resync
+      cmd_ring_tail++;
+      continue;
+    }
+
+    uint16_t frame_len = CMD_HEADER_LEN + frame.len + CMD_CRC_LEN;
+    if (cmd_ring_used() < frame_len) {
+      // Wait for the rest of the frame
+      return;
+    }
+
+    uint16_t crc = CRC16_INIT;
+    for (uint16_t i = 1; i < (CMD_HEADER_LEN + frame.len); i++) {
+      crc = crc16_update(crc, cmd_ring_at(cmd_ring_tail + i));
+    }
+
+    uint16_t frame_crc = cmd_ring_at(cmd_ring_tail + frame_len - 2)
+      | (cmd_ring_at(cmd_ring_tail + frame_len - 1) << 8);
+    if (crc != frame_crc) {
+      DEBUG_COMMENT("CRC error in command frame\n");
+      cmd_crc_errors++;
+      cmd_ring_tail++;
+      continue;
+    }
+
+    uart_cmd_process(&frame);
+    cmd_ring_tail += frame_len;
+  }
+}
+
+void uart_cmd_setup(void) {
+  bluetooth_set_rx_callback(uart_cmd_rx_callback, NULL);
+}
+
+void uart_cmd_loop(void) {
+  if (cmd_rx_pending) {
+    uart_cmd_fill();
+  }
+
+  uart_cmd_parse();
+}
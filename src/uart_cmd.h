@@ -25,9 +25,79 @@
 #ifndef SRC_UART_CMD_H_
 #define SRC_UART_CMD_H_
 
-#define CMD_FAN1_ON             "FAN1_ON"
-#define CMD_FAN1_OFF            "FAN1_OFF"
-#define CMD_FAN2_ON             "FAN2_ON"
-#define CMD_FAN2_OFF            "FAN2_OFF"
+#include <stdint.h>
+#include <stddef.h>
+
+// Framing of commands on the BLE UART. All values are little endian.
+//
+//   | 0xA5 | opcode | seq | len | payload (len bytes) | crc16 |
+//
+// The CRC is CRC-16/CCITT-FALSE over opcode, seq, len and payload.
+// Replies use the same framing with opcode | CMD_REPLY, the seq of the
+// command and a status byte as the first byte of the payload. The seq
+// lets a client pipeline commands and match up the replies later.
+
+#define CMD_SYNC                0xA5
+#define CMD_HEADER_LEN          4
+#define CMD_CRC_LEN             2
+#define CMD_MAX_PAYLOAD         128
+#define CMD_RING_SIZE           512   // Must be a power of 2
+#define CMD_REPLY               0x80
+
+// Opcodes
+
+#define CMD_PING                0x01
+#define CMD_FAN_OVERRIDE        0x10  // u8 fan, i16 level (-1 = auto)
+#define CMD_CURVE_SET           0x20  // f32 min, f32 max, f32 threshold
+#define CMD_CURVE_GET           0x21
+#define CMD_CONFIG_SET          0x22  // u8 key, value
+#define CMD_CONFIG_GET          0x23  // u8 key
+#define CMD_FAN_PROFILE_SET     0x24  // u8 index
+#define CMD_FAN_PROFILE_GET     0x25  // u8 index (optional)
+#define CMD_TELEMETRY           0x30  // u8 rate in Hz (0 = off)
+#define CMD_TELEMETRY_DATA      0x31  // Sent by us, see telemetry.h
+#define CMD_VIRTUAL_SENSOR      0x40  // u8 flags, u32 time (ms), f32 speed,
+                                      // i16 power, u16 ttl (ms, 0 = default)
+#define CMD_PROFILE             0x50  // u8 site, u8 reset (optional)
+#define CMD_LATENCY             0x51  // u8 stage, u8 reset (optional)
+
+// Status
+
+#define CMD_OK                  0x00
+#define CMD_ERR_OPCODE          0x01
+#define CMD_ERR_LENGTH          0x02
+#define CMD_ERR_VALUE           0x03
+#define CMD_ERR_KEY             0x04
+
+// Config keys
+
+#define CMD_KEY_SPEED_MAX       0x01  // f32
+#define CMD_KEY_SPEED_MIN       0x02  // f32
+#define CMD_KEY_SPEED_THRESHOLD 0x03  // f32
+#define CMD_KEY_TRIAC_OFF_DELAY 0x10  // u32
+#define CMD_KEY_TRIAC_ON_DELAY  0x11  // u32
+#define CMD_KEY_SPEED_SENSOR_ID 0x20  // u8[6]
+#define CMD_KEY_POWER_SENSOR_ID 0x21  // u8[6]
+
+// A received frame. The payload is left in the ring buffer and
+// accessed through the uart_cmd_get_*() functions.
+
+typedef struct {
+  uint8_t opcode;
+  uint8_t seq;
+  uint8_t len;
+  uint16_t offset;
+} uart_cmd_frame;
+
+void uart_cmd_setup(void);
+void uart_cmd_loop(void);
+uint8_t uart_cmd_get_u8(const uart_cmd_frame *frame, int i);
+uint16_t uart_cmd_get_u16(const uart_cmd_frame *frame, int i);
+uint32_t uart_cmd_get_u32(const uart_cmd_frame *frame, int i);
+float uart_cmd_get_float(const uart_cmd_frame *frame, int i);
+int uart_cmd_reply(const uart_cmd_frame *frame, uint8_t status,
+                   const uint8_t *data = NULL, int len = 0);
+int uart_cmd_send(uint8_t opcode, uint8_t seq,
+                  const uint8_t *data, int len);
 
 #endif  // SRC_UART_CMD_H_
@@ -29,5 +29,6 @@
 #define PIN_FAN_1             5
 #define PIN_FAN_2             9
 #define PIN_STRIP             10
+#define PIN_PROFILE_BUTTON    PIN_BUTTON1
 
 #endif  // SRC_WIRING_H_
@@ -0,0 +1,188 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Advertised fan state in broadcast.h: the packet encoding, and a
+// follower picking up a leader's packets from the scan callback.
+
+#include <unity.h>
+#include "hal.h"
+#include "config.h"
+#include "bluetooth.h"
+#include "control.h"
+#include "broadcast.h"
+#include "native/bluetooth_native.h"
+#include "native/firmware.h"
+
+static const uint8_t test_leader[6] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+static const uint8_t test_other[6] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06};
+static const uint8_t test_any[6] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+// The last leader packet stays stored between tests, so each test starts
+// later on the clock than that packet's timeout
+static unsigned long test_start = 0;
+
+static void test_advance_ms(unsigned long ms) {
+  hal_native_advance(hal_native_now() + ms * 1000ULL);
+}
+
+static void test_follow(const uint8_t *leader) {
+  config_data data = *config_get();
+  data.follower_enable = true;
+  memcpy(data.follower_leader_id, leader, 6);
+  config_publish(&data);
+}
+
+static void test_send(const uint8_t *mac, float speed, int power) {
+  broadcast_data data = {1, speed, power, {10, 20}};
+  uint8_t buf[BROADCAST_LEN];
+  TEST_ASSERT_EQUAL_INT(BROADCAST_LEN, broadcast_encode(buf, &data));
+  broadcast_receive(mac, buf, sizeof(buf));
+}
+
+static void test_advertised(broadcast_data *data) {
+  const uint8_t *msd;
+  TEST_ASSERT_EQUAL_INT(BROADCAST_LEN, bluetooth_native_advertising(&msd));
+  TEST_ASSERT_EQUAL_INT(0, broadcast_decode(msd, BROADCAST_LEN, data));
+}
+
+void setUp(void) {
+  firmware_setup();
+  test_start += 2 * SENSOR_TIMEOUT;
+  test_advance_ms(test_start);
+}
+
+void tearDown(void) {
+}
+
+void test_round_trip(void) {
+  broadcast_data in = {42, 12.34, -250, {0, 255}};
+  broadcast_data out;
+  uint8_t buf[BROADCAST_LEN];
+  TEST_ASSERT_EQUAL_INT(BROADCAST_LEN, broadcast_encode(buf, &in));
+  TEST_ASSERT_EQUAL_HEX8(BROADCAST_COMPANY_ID & 0xFF, buf[0]);
+  TEST_ASSERT_EQUAL_HEX8(BROADCAST_COMPANY_ID >> 8, buf[1]);
+  TEST_ASSERT_EQUAL_HEX8(BROADCAST_MAGIC, buf[2]);
+  TEST_ASSERT_EQUAL_HEX8(BROADCAST_VERSION, buf[3]);
+
+  TEST_ASSERT_EQUAL_INT(0, broadcast_decode(buf, sizeof(buf), &out));
+  TEST_ASSERT_EQUAL_UINT8(42, out.seq);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 12.34, out.speed);
+  TEST_ASSERT_EQUAL_INT(-250, out.power);
+  TEST_ASSERT_EQUAL_UINT8(0, out.op[0]);
+  TEST_ASSERT_EQUAL_UINT8(255, out.op[1]);
+}
+
+void test_speed_clamped(void) {
+  const float speeds[] = {-5.0, NAN, 1000.0, INFINITY};
+  const float expect[] = {0.0, 0.0, 655.35, 655.35};
+  for (int i = 0; i < 4; i++) {
+    broadcast_data in = {0, speeds[i], 0, {0, 0}};
+    broadcast_data out;
+    uint8_t buf[BROADCAST_LEN];
+    broadcast_encode(buf, &in);
+    TEST_ASSERT_EQUAL_INT(0, broadcast_decode(buf, sizeof(buf), &out));
+    TEST_ASSERT_FLOAT_WITHIN(0.001, expect[i], out.speed);
+  }
+}
+
+void test_decode_rejects(void) {
+  broadcast_data in = {0, 10.0, 100, {1, 2}};
+  broadcast_data out;
+  uint8_t buf[BROADCAST_LEN];
+  broadcast_encode(buf, &in);
+  TEST_ASSERT_EQUAL_INT(-1, broadcast_decode(buf, BROADCAST_LEN - 1, &out));
+
+  // Company, magic and version
+  for (int i = 0; i < 4; i++) {
+    buf[i] ^= 0x01;
+    TEST_ASSERT_EQUAL_INT(-1, broadcast_decode(buf, sizeof(buf), &out));
+    buf[i] ^= 0x01;
+  }
+  TEST_ASSERT_EQUAL_INT(0, broadcast_decode(buf, sizeof(buf), &out));
+}
+
+void test_follow_any_leader(void) {
+  test_follow(test_any);
+  TEST_ASSERT_FALSE(broadcast_leader_valid());
+  test_send(test_other, 15.0, 200);
+  TEST_ASSERT_TRUE(broadcast_leader_valid());
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 15.0, broadcast_leader_speed());
+  TEST_ASSERT_EQUAL_INT(200, broadcast_leader_power());
+  TEST_ASSERT_EQUAL_UINT32(hal_micros(), broadcast_leader_stamp());
+
+  test_advance_ms(SENSOR_TIMEOUT);
+  TEST_ASSERT_FALSE(broadcast_leader_valid());
+}
+
+void test_follow_one_leader(void) {
+  test_follow(test_leader);
+  test_send(test_other, 15.0, 200);
+  TEST_ASSERT_FALSE(broadcast_leader_valid());
+
+  test_send(test_leader, 20.0, 300);
+  test_send(test_other, 15.0, 200);
+  TEST_ASSERT_TRUE(broadcast_leader_valid());
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 20.0, broadcast_leader_speed());
+  TEST_ASSERT_EQUAL_INT(300, broadcast_leader_power());
+}
+
+void test_advertised_state(void) {
+  // The default config broadcasts, with a new seq for each change
+  control_set_override(0, 100);
+  control_apply();
+  broadcast_refresh();
+  broadcast_loop();
+
+  broadcast_data out;
+  test_advertised(&out);
+  TEST_ASSERT_EQUAL_UINT8(100, out.op[0]);
+  uint8_t seq = out.seq;
+
+  test_advance_ms(BROADCAST_PERIOD);
+  broadcast_loop();
+  test_advertised(&out);
+  TEST_ASSERT_EQUAL_UINT8(seq, out.seq);
+
+  control_set_override(0, 50);
+  control_apply();
+  test_advance_ms(BROADCAST_PERIOD);
+  broadcast_loop();
+  test_advertised(&out);
+  TEST_ASSERT_EQUAL_UINT8(50, out.op[0]);
+  TEST_ASSERT_EQUAL_UINT8(static_cast<uint8_t>(seq + 1), out.seq);
+}
+
+int main(int argc, char **argv) {
+  (void) argc;
+  (void) argv;
+
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_speed_clamped);
+  RUN_TEST(test_decode_rejects);
+  RUN_TEST(test_follow_any_leader);
+  RUN_TEST(test_follow_one_leader);
+  RUN_TEST(test_advertised_state);
+  return UNITY_END();
+}
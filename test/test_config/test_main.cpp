@@ -0,0 +1,170 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// config_validate() and publishing of profiles in config.h
+
+#include <unity.h>
+#include "hal.h"
+#include "colormap.h"
+#include "config.h"
+#include "sensor.h"
+
+static config_data test_data;
+
+void setUp(void) {
+  config_set_defaults();
+  test_data = *config_get();
+}
+
+void tearDown(void) {
+}
+
+void test_defaults_valid(void) {
+  TEST_ASSERT_EQUAL_INT(0, config_validate(&test_data));
+}
+
+void test_speed_range(void) {
+  test_data.speed_min = -1.0;
+  TEST_ASSERT_EQUAL_INT(-1, config_validate(&test_data));
+
+  test_data.speed_min = 15.0;
+  test_data.speed_max = 15.0;
+  TEST_ASSERT_EQUAL_INT(-1, config_validate(&test_data));
+}
+
+void test_speed_threshold(void) {
+  test_data.speed_threshold = -0.1;
+  TEST_ASSERT_EQUAL_INT(-2, config_validate(&test_data));
+
+  test_data.speed_threshold = test_data.speed_max + 1;
+  TEST_ASSERT_EQUAL_INT(-2, config_validate(&test_data));
+}
+
+void test_triac_delays(void) {
+  test_data.triac_off_delay = 0;
+  TEST_ASSERT_EQUAL_INT(-3, config_validate(&test_data));
+
+  test_data.triac_off_delay = 10001;
+  TEST_ASSERT_EQUAL_INT(-3, config_validate(&test_data));
+
+  test_data.triac_off_delay = 4000;
+  test_data.triac_on_delay = 4000;
+  TEST_ASSERT_EQUAL_INT(-3, config_validate(&test_data));
+
+  test_data.triac_off_delay = 10000;
+  test_data.triac_on_delay = 9999;
+  TEST_ASSERT_EQUAL_INT(0, config_validate(&test_data));
+}
+
+void test_bluetooth_intervals(void) {
+  test_data.bt_conn_active_interval = 7;
+  TEST_ASSERT_EQUAL_INT(-4, config_validate(&test_data));
+
+  test_data.bt_conn_active_interval = 8;
+  test_data.bt_uart_interval = 4001;
+  TEST_ASSERT_EQUAL_INT(-4, config_validate(&test_data));
+
+  test_data.bt_uart_interval = 4000;
+  test_data.bt_conn_timeout = 99;
+  TEST_ASSERT_EQUAL_INT(-4, config_validate(&test_data));
+}
+
+void test_enums(void) {
+  test_data.virtual_priority = VIRTUAL_ONLY + 1;
+  TEST_ASSERT_EQUAL_INT(-5, config_validate(&test_data));
+
+  test_data.virtual_priority = VIRTUAL_ONLY;
+  test_data.indicator_colormap = COLORMAP_CUSTOM + 1;
+  TEST_ASSERT_EQUAL_INT(-7, config_validate(&test_data));
+}
+
+void test_ridelog(void) {
+  test_data.ridelog_period = 99;
+  TEST_ASSERT_EQUAL_INT(-6, config_validate(&test_data));
+
+  test_data.ridelog_period = 100;
+  test_data.ridelog_size = 3;
+  TEST_ASSERT_EQUAL_INT(-6, config_validate(&test_data));
+}
+
+void test_publish(void) {
+  // Runtime changes are dirty, a load of the file is not
+  uint32_t dirty = config_dirty_generation();
+  const config_live *live = config_get_live();
+
+  test_data.speed_max = 30.0;
+  config_publish(&test_data);
+  TEST_ASSERT_TRUE(config_get_live() != live);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 30.0, config_get()->speed_max);
+  TEST_ASSERT_EQUAL_UINT32(dirty + 1, config_dirty_generation());
+
+  config_data profiles[2] = {test_data, test_data};
+  snprintf(profiles[1].name, CONFIG_NAME_LEN, "fast");
+  config_publish_profiles(profiles, 2, 1);
+  TEST_ASSERT_EQUAL_INT(1, config_profile_get());
+  TEST_ASSERT_EQUAL_INT(2, config_profile_count());
+  TEST_ASSERT_EQUAL_INT(0, strcmp("fast", config_get()->name));
+  TEST_ASSERT_EQUAL_UINT32(dirty + 1, config_dirty_generation());
+
+  TEST_ASSERT_EQUAL_INT(0, config_profile_select(0));
+  TEST_ASSERT_EQUAL_INT(-1, config_profile_select(2));
+  TEST_ASSERT_EQUAL_UINT32(dirty + 2, config_dirty_generation());
+}
+
+void test_change_seen(void) {
+  // Two publishes, or two selects, can leave the same config_live
+  // active, so changes are seen from the generations
+  config_data profiles[2] = {test_data, test_data};
+  config_publish_profiles(profiles, 2, 0);
+  const config_live *live = config_get_live();
+  uint32_t generation = live->generation;
+
+  config_publish(&test_data);
+  config_publish(&test_data);
+  TEST_ASSERT_TRUE(config_get_live() == live);
+  TEST_ASSERT_TRUE(config_get_live()->generation != generation);
+
+  uint32_t select = config_select_generation();
+  TEST_ASSERT_EQUAL_INT(0, config_profile_select(1));
+  TEST_ASSERT_EQUAL_INT(0, config_profile_select(0));
+  TEST_ASSERT_TRUE(config_get_live() == live);
+  TEST_ASSERT_EQUAL_UINT32(select + 2, config_select_generation());
+}
+
+int main(int argc, char **argv) {
+  (void) argc;
+  (void) argv;
+
+  UNITY_BEGIN();
+  RUN_TEST(test_defaults_valid);
+  RUN_TEST(test_speed_range);
+  RUN_TEST(test_speed_threshold);
+  RUN_TEST(test_triac_delays);
+  RUN_TEST(test_bluetooth_intervals);
+  RUN_TEST(test_enums);
+  RUN_TEST(test_ridelog);
+  RUN_TEST(test_publish);
+  RUN_TEST(test_change_seen);
+  return UNITY_END();
+}
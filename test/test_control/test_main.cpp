@@ -0,0 +1,129 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// The control law, control_calculate() in control.h, with the default
+// speed curve of 5 - 15 mph and a threshold of 1.5 mph.
+
+#include <unity.h>
+#include "hal.h"
+#include "config.h"
+#include "control.h"
+#include "native/firmware.h"
+
+static void test_advance_ms(unsigned long ms) {
+  hal_native_advance(hal_native_now() + ms * 1000ULL);
+}
+
+void setUp(void) {
+  firmware_setup();
+  control_set_override(0, CONTROL_AUTO);
+  control_set_override(1, CONTROL_AUTO);
+  control_update(0);
+}
+
+void tearDown(void) {
+}
+
+void test_full_above_max(void) {
+  TEST_ASSERT_EQUAL_UINT8(255, control_calculate(15.0));
+  TEST_ASSERT_EQUAL_UINT8(255, control_calculate(40.0));
+}
+
+void test_curve(void) {
+  // 255 * (speed - min) / max
+  TEST_ASSERT_EQUAL_UINT8(0, control_calculate(5.0));
+  TEST_ASSERT_EQUAL_UINT8(85, control_calculate(10.0));
+  TEST_ASSERT_EQUAL_UINT8(161, control_calculate(14.5));
+
+  uint8_t last = 0;
+  for (float speed = 5.0; speed < 15.0; speed += 0.25) {
+    uint8_t op = control_calculate(speed);
+    TEST_ASSERT_TRUE(op >= last);
+    last = op;
+  }
+}
+
+void test_threshold(void) {
+  TEST_ASSERT_EQUAL_UINT8(1, control_calculate(1.5));
+  TEST_ASSERT_EQUAL_UINT8(1, control_calculate(4.9));
+}
+
+void test_holds_below_threshold(void) {
+  // The last output is kept until the off timer runs out
+  control_update(20.0);
+  TEST_ASSERT_EQUAL_UINT8(255, control_get_output(0));
+  TEST_ASSERT_EQUAL_UINT8(255, control_calculate(1.0));
+
+  test_advance_ms(CONTROL_OFF_TIMER - 1000);
+  TEST_ASSERT_EQUAL_UINT8(255, control_calculate(1.0));
+
+  test_advance_ms(2000);
+  TEST_ASSERT_EQUAL_UINT8(0, control_calculate(1.0));
+}
+
+void test_riding_resets_off_timer(void) {
+  control_update(10.0);
+  test_advance_ms(CONTROL_OFF_TIMER - 1000);
+  control_update(10.0);
+  test_advance_ms(2000);
+  TEST_ASSERT_EQUAL_UINT8(85, control_calculate(1.0));
+}
+
+void test_override(void) {
+  control_update(20.0);
+  control_set_override(1, 10);
+  control_apply();
+  TEST_ASSERT_EQUAL_UINT8(255, control_get_output(0));
+  TEST_ASSERT_EQUAL_UINT8(10, control_get_output(1));
+
+  control_set_override(1, CONTROL_AUTO);
+  control_apply();
+  TEST_ASSERT_EQUAL_UINT8(255, control_get_output(1));
+}
+
+void test_follows_config(void) {
+  config_data data = *config_get();
+  data.speed_min = 10.0;
+  data.speed_max = 20.0;
+  config_publish(&data);
+
+  TEST_ASSERT_EQUAL_UINT8(1, control_calculate(9.0));
+  TEST_ASSERT_EQUAL_UINT8(63, control_calculate(15.0));
+  TEST_ASSERT_EQUAL_UINT8(255, control_calculate(20.0));
+}
+
+int main(int argc, char **argv) {
+  (void) argc;
+  (void) argv;
+
+  UNITY_BEGIN();
+  RUN_TEST(test_full_above_max);
+  RUN_TEST(test_curve);
+  RUN_TEST(test_threshold);
+  RUN_TEST(test_holds_below_threshold);
+  RUN_TEST(test_riding_resets_off_timer);
+  RUN_TEST(test_override);
+  RUN_TEST(test_follows_config);
+  return UNITY_END();
+}
@@ -0,0 +1,133 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Level bars in levelbar.h: which pixels are lit for a level, the
+// partial top pixel and the dithering of dim channels.
+
+#include <unity.h>
+#include "hal.h"
+#include "colormap.h"
+#include "indicator.h"
+#include "levelbar.h"
+
+#define TEST_FRAMES             16    // Length of the dither cycle
+
+static int test_full(const uint32_t *bar, uint32_t color) {
+  // Full pixels at the bottom, then at most one partial, then off. The
+  // bottom of "hot" is black after gamma, so those bars stay dark.
+  int full = 0;
+  while ((full < INDICATOR_BAR_PIXELS) && color && (bar[full] == color)) {
+    full++;
+  }
+  for (int i = full + 1; i < INDICATOR_BAR_PIXELS; i++) {
+    TEST_ASSERT_EQUAL_HEX32(0, bar[i]);
+  }
+  return full;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_empty_and_full(void) {
+  uint32_t bar[INDICATOR_BAR_PIXELS];
+  for (uint8_t map = COLORMAP_HOT; map <= COLORMAP_CUSTOM; map++) {
+    for (int frame = 0; frame < TEST_FRAMES; frame++) {
+      levelbar_draw(bar, map, 0, frame);
+      for (int i = 0; i < INDICATOR_BAR_PIXELS; i++) {
+        TEST_ASSERT_EQUAL_HEX32(0, bar[i]);
+      }
+
+      levelbar_draw(bar, map, 255, frame);
+      uint32_t color = levelbar_color(map, 255);
+      TEST_ASSERT_EQUAL_INT(INDICATOR_BAR_PIXELS, test_full(bar, color));
+    }
+  }
+}
+
+void test_colormap_ends(void) {
+  // "hot" runs from a dim red to white
+  TEST_ASSERT_EQUAL_HEX32(0xFFFFFF, levelbar_color(COLORMAP_HOT, 255));
+  TEST_ASSERT_EQUAL_HEX32(0, levelbar_color(COLORMAP_HOT, 0) & 0x00FFFF);
+  TEST_ASSERT_EQUAL_HEX32(0x0000FF, levelbar_color(COLORMAP_CUSTOM, 0));
+  TEST_ASSERT_EQUAL_HEX32(0xFF0000, levelbar_color(COLORMAP_CUSTOM, 255));
+
+  // Unknown maps fall back to "hot"
+  TEST_ASSERT_EQUAL_HEX32(levelbar_color(COLORMAP_HOT, 100),
+    levelbar_color(99, 100));
+}
+
+void test_pixels_rise_with_level(void) {
+  // The lit part of the bar is level / 255 of its length
+  uint32_t bar[INDICATOR_BAR_PIXELS];
+  int last = 0;
+  for (int level = 0; level < 256; level++) {
+    levelbar_draw(bar, COLORMAP_HOT, level, 0);
+    int full = test_full(bar, levelbar_color(COLORMAP_HOT, level));
+    int lit = full + ((full < INDICATOR_BAR_PIXELS) && bar[full]);
+    TEST_ASSERT_TRUE(lit >= last);
+    TEST_ASSERT_TRUE(lit >= (level * INDICATOR_BAR_PIXELS) / 255);
+    TEST_ASSERT_TRUE(lit <= (level * INDICATOR_BAR_PIXELS + 254) / 255);
+    last = lit;
+  }
+}
+
+void test_dim(void) {
+  for (int frame = 0; frame < TEST_FRAMES; frame++) {
+    TEST_ASSERT_EQUAL_HEX32(0, levelbar_dim(0xFFFFFF, 0, frame));
+    TEST_ASSERT_EQUAL_HEX32(0x804010, levelbar_dim(0x804010, 255, frame));
+  }
+  TEST_ASSERT_EQUAL_HEX32(0x400000, levelbar_dim(0x800000, 127, 0));
+}
+
+void test_dither_average(void) {
+  // Over a dither cycle a dim channel averages to its exact value
+  const uint8_t channels[] = {1, 7, 20, 31};
+  for (int c = 0; c < 4; c++) {
+    for (int scale = 1; scale < 256; scale += 17) {
+      int sum = 0;
+      for (int frame = 0; frame < TEST_FRAMES; frame++) {
+        sum += levelbar_dim(channels[c], scale, frame);
+      }
+      float exact = channels[c] * (scale + 1) / 256.0;
+      TEST_ASSERT_FLOAT_WITHIN(1.0 / TEST_FRAMES, exact,
+        static_cast<float>(sum) / TEST_FRAMES);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  (void) argc;
+  (void) argv;
+
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_and_full);
+  RUN_TEST(test_colormap_ends);
+  RUN_TEST(test_pixels_rise_with_level);
+  RUN_TEST(test_dim);
+  RUN_TEST(test_dither_average);
+  return UNITY_END();
+}
@@ -0,0 +1,168 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Ride log sector headers and CRC (ridelog_sector.cpp), as written by
+// the device and read back by the converter and replay.
+
+#include <unity.h>
+#include <string.h>
+#include "crc.h"
+#include "ridelog.h"
+
+#define TEST_SESSION            0x1234ABCD
+
+static uint8_t test_sector[RIDELOG_SECTOR_SIZE];
+
+static void test_fill(int count) {
+  // Records with a pattern over all their bytes
+  for (int i = 0; i < count * static_cast<int>(sizeof(ridelog_record));
+       i++) {
+    test_sector[sizeof(ridelog_header) + i] = i * 7;
+  }
+}
+
+static int test_check(uint32_t sequence, const uint32_t *session) {
+  return ridelog_sector_check(test_sector, RIDELOG_MAGIC,
+    sizeof(ridelog_record), sequence, session);
+}
+
+void setUp(void) {
+  memset(test_sector, 0xA5, sizeof(test_sector));
+  test_fill(10);
+  ridelog_sector_seal(test_sector, RIDELOG_MAGIC, sizeof(ridelog_record),
+    10, 3, TEST_SESSION);
+}
+
+void tearDown(void) {
+}
+
+void test_layout(void) {
+  // Shared with utils/ridelog.py
+  TEST_ASSERT_EQUAL_INT(20, sizeof(ridelog_header));
+  TEST_ASSERT_EQUAL_INT(16, sizeof(ridelog_record));
+  TEST_ASSERT_EQUAL_INT(32, sizeof(ridelog_trace_record));
+  TEST_ASSERT_EQUAL_INT(254, RIDELOG_RECORDS);
+  TEST_ASSERT_EQUAL_INT(127, RIDELOG_TRACE_RECORDS);
+}
+
+void test_crc32_check_value(void) {
+  // The CRC-32 of zlib and binascii.crc32()
+  const uint8_t check[] = "123456789";
+  TEST_ASSERT_EQUAL_HEX32(0xCBF43926, crc32(check, 9));
+}
+
+void test_header(void) {
+  const ridelog_header *header =
+    reinterpret_cast<const ridelog_header*>(test_sector);
+  TEST_ASSERT_EQUAL_HEX32(RIDELOG_MAGIC, header->magic);
+  TEST_ASSERT_EQUAL_UINT8(RIDELOG_VERSION, header->version);
+  TEST_ASSERT_EQUAL_UINT8(sizeof(ridelog_record), header->record_size);
+  TEST_ASSERT_EQUAL_INT(10, header->count);
+  TEST_ASSERT_EQUAL_UINT32(3, header->sequence);
+  TEST_ASSERT_EQUAL_HEX32(TEST_SESSION, header->session);
+
+  // CRC of the header up to the CRC and the used records
+  uint32_t crc = crc32_update(CRC32_INIT, test_sector,
+    offsetof(ridelog_header, crc));
+  crc = ~crc32_update(crc, &test_sector[sizeof(ridelog_header)],
+    10 * sizeof(ridelog_record));
+  TEST_ASSERT_EQUAL_HEX32(crc, header->crc);
+}
+
+void test_unused_erased(void) {
+  int used = sizeof(ridelog_header) + 10 * sizeof(ridelog_record);
+  TEST_ASSERT_EACH_EQUAL_HEX8(0xFF, &test_sector[used],
+    RIDELOG_SECTOR_SIZE - used);
+}
+
+void test_valid(void) {
+  const uint32_t session = TEST_SESSION;
+  TEST_ASSERT_EQUAL_INT(0, test_check(3, NULL));
+  TEST_ASSERT_EQUAL_INT(0, test_check(3, &session));
+}
+
+void test_wrong_sequence(void) {
+  TEST_ASSERT_EQUAL_INT(-1, test_check(2, NULL));
+  TEST_ASSERT_EQUAL_INT(-1, test_check(4, NULL));
+}
+
+void test_wrong_magic(void) {
+  TEST_ASSERT_EQUAL_INT(-1, ridelog_sector_check(test_sector,
+    RIDELOG_TRACE_MAGIC, sizeof(ridelog_record), 3, NULL));
+  TEST_ASSERT_EQUAL_INT(-1, ridelog_sector_check(test_sector,
+    RIDELOG_MAGIC, sizeof(ridelog_trace_record), 3, NULL));
+}
+
+void test_other_session(void) {
+  // A sector left by an earlier session in the same clusters
+  const uint32_t session = TEST_SESSION + 1;
+  TEST_ASSERT_EQUAL_INT(-3, test_check(3, &session));
+}
+
+void test_corrupt(void) {
+  test_sector[sizeof(ridelog_header) + 5] ^= 0x01;
+  TEST_ASSERT_EQUAL_INT(-4, test_check(3, NULL));
+  test_sector[sizeof(ridelog_header) + 5] ^= 0x01;
+
+  ridelog_header *header = reinterpret_cast<ridelog_header*>(test_sector);
+  header->session ^= 0x100;
+  const uint32_t session = header->session;
+  TEST_ASSERT_EQUAL_INT(-4, test_check(3, &session));
+}
+
+void test_count(void) {
+  ridelog_header *header = reinterpret_cast<ridelog_header*>(test_sector);
+  header->count = RIDELOG_RECORDS + 1;
+  TEST_ASSERT_EQUAL_INT(-2, test_check(3, NULL));
+
+  // A full sector has nothing erased
+  test_fill(RIDELOG_RECORDS);
+  ridelog_sector_seal(test_sector, RIDELOG_MAGIC, sizeof(ridelog_record),
+    RIDELOG_RECORDS, 0, TEST_SESSION);
+  TEST_ASSERT_EQUAL_INT(0, test_check(0, NULL));
+}
+
+void test_erased_sector(void) {
+  memset(test_sector, 0xFF, sizeof(test_sector));
+  TEST_ASSERT_EQUAL_INT(-1, test_check(0, NULL));
+}
+
+int main(int argc, char **argv) {
+  (void) argc;
+  (void) argv;
+
+  UNITY_BEGIN();
+  RUN_TEST(test_layout);
+  RUN_TEST(test_crc32_check_value);
+  RUN_TEST(test_header);
+  RUN_TEST(test_unused_erased);
+  RUN_TEST(test_valid);
+  RUN_TEST(test_wrong_sequence);
+  RUN_TEST(test_wrong_magic);
+  RUN_TEST(test_other_session);
+  RUN_TEST(test_corrupt);
+  RUN_TEST(test_count);
+  RUN_TEST(test_erased_sector);
+  return UNITY_END();
+}
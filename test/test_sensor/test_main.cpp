@@ -0,0 +1,154 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Virtual sensor samples, sensor_virtual_update() in sensor.h: order,
+// expiry, rejection of bad speeds and reset when the app disconnects.
+
+#include <unity.h>
+#include "hal.h"
+#include "config.h"
+#include "sensor.h"
+#include "native/bluetooth_native.h"
+#include "native/firmware.h"
+
+#define TEST_TTL                500   // ms
+
+static void test_advance_ms(unsigned long ms) {
+  hal_native_advance(hal_native_now() + ms * 1000ULL);
+}
+
+static int test_update(uint32_t timestamp, float speed) {
+  return sensor_virtual_update(VIRTUAL_SPEED, timestamp, speed, 0,
+                               TEST_TTL);
+}
+
+void setUp(void) {
+  firmware_setup();
+  sensor_virtual_reset();
+  bluetooth_native_set_connected(false, true);
+  sensor_loop();
+}
+
+void tearDown(void) {
+}
+
+void test_in_order(void) {
+  TEST_ASSERT_EQUAL_INT(0, test_update(1000, 10.0));
+  TEST_ASSERT_EQUAL_INT(0, test_update(1000, 11.0));
+  TEST_ASSERT_EQUAL_INT(0, test_update(1100, 12.0));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 12.0, sensor_get_speed());
+  TEST_ASSERT_EQUAL_INT(SENSOR_SOURCE_VIRTUAL, sensor_get_source());
+}
+
+void test_out_of_order_dropped(void) {
+  TEST_ASSERT_EQUAL_INT(0, test_update(1000, 10.0));
+  TEST_ASSERT_EQUAL_INT(-2, test_update(999, 20.0));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 10.0, sensor_get_speed());
+}
+
+void test_timestamp_wraps(void) {
+  TEST_ASSERT_EQUAL_INT(0, test_update(0xFFFFFF00, 10.0));
+  TEST_ASSERT_EQUAL_INT(0, test_update(0x00000010, 11.0));
+  TEST_ASSERT_EQUAL_INT(-2, test_update(0xFFFFFF80, 12.0));
+}
+
+void test_expiry(void) {
+  TEST_ASSERT_EQUAL_INT(0, test_update(100000, 10.0));
+  test_advance_ms(TEST_TTL - 1);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 10.0, sensor_get_speed());
+  TEST_ASSERT_EQUAL_INT(-2, test_update(5, 10.0));
+
+  // Once expired an app with a restarted clock is accepted
+  test_advance_ms(1);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.0, sensor_get_speed());
+  TEST_ASSERT_EQUAL_INT(SENSOR_SOURCE_NONE, sensor_get_source());
+  TEST_ASSERT_EQUAL_INT(0, test_update(5, 8.0));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 8.0, sensor_get_speed());
+}
+
+void test_reset_on_disconnect(void) {
+  TEST_ASSERT_EQUAL_INT(0, test_update(100000, 10.0));
+  bluetooth_native_set_connected(false, false);
+  sensor_loop();
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.0, sensor_get_speed());
+  TEST_ASSERT_EQUAL_INT(SENSOR_SOURCE_NONE, sensor_get_source());
+
+  bluetooth_native_set_connected(false, true);
+  sensor_loop();
+  TEST_ASSERT_EQUAL_INT(0, test_update(5, 8.0));
+}
+
+void test_bad_speed(void) {
+  TEST_ASSERT_EQUAL_INT(-3, test_update(1, -1.0));
+  TEST_ASSERT_EQUAL_INT(-3, test_update(2, NAN));
+  TEST_ASSERT_EQUAL_INT(-3, test_update(3, INFINITY));
+  TEST_ASSERT_EQUAL_INT(0, test_update(4, 0.0));
+
+  // Power only samples carry no speed to check
+  TEST_ASSERT_EQUAL_INT(0, sensor_virtual_update(VIRTUAL_POWER, 5, NAN,
+    200, TEST_TTL));
+  TEST_ASSERT_EQUAL_INT(200, sensor_get_power());
+}
+
+void test_pending(void) {
+  TEST_ASSERT_FALSE(sensor_virtual_pending());
+  TEST_ASSERT_EQUAL_INT(0, test_update(1, 10.0));
+  TEST_ASSERT_TRUE(sensor_virtual_pending());
+  TEST_ASSERT_FALSE(sensor_virtual_pending());
+}
+
+void test_physical_preferred(void) {
+  // With the default fallback priority a physical sensor wins
+  test_advance_ms(1000);
+  bluetooth_native_set_connected(true, true);
+  bluetooth_native_sensor(20.0, 0);
+  TEST_ASSERT_EQUAL_INT(0, test_update(1, 10.0));
+  TEST_ASSERT_FALSE(sensor_virtual_pending());
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 20.0, sensor_get_speed());
+  TEST_ASSERT_EQUAL_INT(SENSOR_SOURCE_PHYSICAL, sensor_get_source());
+}
+
+void test_virtual_off(void) {
+  config_data data = *config_get();
+  data.virtual_priority = VIRTUAL_OFF;
+  config_publish(&data);
+  TEST_ASSERT_EQUAL_INT(-1, test_update(1, 10.0));
+}
+
+int main(int argc, char **argv) {
+  (void) argc;
+  (void) argv;
+
+  UNITY_BEGIN();
+  RUN_TEST(test_in_order);
+  RUN_TEST(test_out_of_order_dropped);
+  RUN_TEST(test_timestamp_wraps);
+  RUN_TEST(test_expiry);
+  RUN_TEST(test_reset_on_disconnect);
+  RUN_TEST(test_bad_speed);
+  RUN_TEST(test_pending);
+  RUN_TEST(test_physical_preferred);
+  RUN_TEST(test_virtual_off);
+  return UNITY_END();
+}
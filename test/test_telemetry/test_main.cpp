@@ -0,0 +1,265 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// The telemetry encoder in telemetry.h. Frames sent on the fake UART
+// are decoded here and compared with the samples taken, and the size of
+// the largest frames and samples is checked against the bounds.
+
+#include <unity.h>
+#include "hal.h"
+#include "crc.h"
+#include "bluetooth.h"
+#include "control.h"
+#include "triac.h"
+#include "sensor.h"
+#include "uart_cmd.h"
+#include "telemetry.h"
+#include "native/bluetooth_native.h"
+#include "native/firmware.h"
+
+#define TEST_RATE               20    // Hz
+#define TEST_STEPS              200
+#define TEST_PERIOD             (1000 / TEST_RATE)
+
+typedef struct {
+  int count;
+  uint32_t time[TEST_STEPS];
+  int32_t samples[TEST_STEPS][TELEMETRY_NUM_FIELDS];
+  int frames;
+  int max_frame;                      // Payload bytes
+  int max_sample;                     // Bytes of a delta sample
+} test_stream;
+
+static test_stream test_sent;
+static test_stream test_received;
+static int32_t test_last[TELEMETRY_NUM_FIELDS];
+static uint32_t test_last_time;
+
+static uint32_t test_get_varint(const uint8_t *buf, int len, int *pos) {
+  uint32_t val = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    TEST_ASSERT_TRUE(*pos < len);
+    uint8_t b = buf[(*pos)++];
+    val |= static_cast<uint32_t>(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      return val;
+    }
+  }
+  TEST_ASSERT_TRUE(false);
+  return 0;
+}
+
+static int32_t test_unzigzag(uint32_t val) {
+  return static_cast<int32_t>((val >> 1) ^ (0U - (val & 1)));
+}
+
+static void test_decode(const uint8_t *buf, int len) {
+  TEST_ASSERT_TRUE(len >= TELEMETRY_HEADER_LEN);
+  TEST_ASSERT_EQUAL_UINT8(TELEMETRY_VERSION, buf[0]);
+  int count = buf[1];
+  TEST_ASSERT_TRUE(count > 0);
+
+  test_stream *r = &test_received;
+  int pos = TELEMETRY_HEADER_LEN;
+  test_last_time = buf[2] | (buf[3] << 8) | (buf[4] << 16)
+    | (static_cast<uint32_t>(buf[5]) << 24);
+  for (int i = 0; i < TELEMETRY_NUM_FIELDS; i++) {
+    test_last[i] = test_unzigzag(test_get_varint(buf, len, &pos));
+  }
+
+  for (int k = 0; k < count; k++) {
+    if (k) {
+      int start = pos;
+      test_last_time += test_get_varint(buf, len, &pos);
+      TEST_ASSERT_TRUE(pos < len);
+      uint8_t mask = buf[pos++];
+      for (int i = 0; i < TELEMETRY_NUM_FIELDS; i++) {
+        if (mask & (1 << i)) {
+          uint32_t delta = test_get_varint(buf, len, &pos);
+          test_last[i] = static_cast<int32_t>(
+            static_cast<uint32_t>(test_last[i])
+            + static_cast<uint32_t>(test_unzigzag(delta)));
+        }
+      }
+      if ((pos - start) > r->max_sample) {
+        r->max_sample = pos - start;
+      }
+    }
+
+    TEST_ASSERT_TRUE(r->count < TEST_STEPS);
+    r->time[r->count] = test_last_time;
+    memcpy(r->samples[r->count], test_last, sizeof(test_last));
+    r->count++;
+  }
+  TEST_ASSERT_EQUAL_INT(len, pos);
+
+  // Frames fit one notification unless a key sample alone does not
+  int size = bluetooth_uart_mtu() - CMD_HEADER_LEN - CMD_CRC_LEN;
+  if (size > CMD_MAX_PAYLOAD) {
+    size = CMD_MAX_PAYLOAD;
+  }
+  if (count > 1) {
+    TEST_ASSERT_LESS_OR_EQUAL(size, len);
+  }
+
+  r->frames++;
+  if (len > r->max_frame) {
+    r->max_frame = len;
+  }
+}
+
+static void test_receive(void) {
+  uint8_t buf[CMD_HEADER_LEN + CMD_MAX_PAYLOAD + CMD_CRC_LEN];
+  while (bluetooth_native_uart_tx(buf, CMD_HEADER_LEN) == CMD_HEADER_LEN) {
+    TEST_ASSERT_EQUAL_HEX8(CMD_SYNC, buf[0]);
+    TEST_ASSERT_EQUAL_HEX8(CMD_TELEMETRY_DATA, buf[1]);
+    int len = buf[3];
+    TEST_ASSERT_LESS_OR_EQUAL(CMD_MAX_PAYLOAD, len);
+    TEST_ASSERT_EQUAL_INT(len + CMD_CRC_LEN,
+      bluetooth_native_uart_tx(&buf[CMD_HEADER_LEN], len + CMD_CRC_LEN));
+    uint16_t crc = buf[CMD_HEADER_LEN + len]
+      | (buf[CMD_HEADER_LEN + len + 1] << 8);
+    TEST_ASSERT_EQUAL_HEX16(crc16(&buf[1], CMD_HEADER_LEN - 1 + len), crc);
+    test_decode(&buf[CMD_HEADER_LEN], len);
+  }
+}
+
+static void test_step(int32_t speed) {
+  // Take one sample and keep what it should hold
+  hal_native_advance(hal_native_now() + TEST_PERIOD * 1000ULL);
+  telemetry_loop();
+
+  test_stream *s = &test_sent;
+  int32_t *sample = s->samples[s->count];
+  s->time[s->count] = hal_millis();
+  sample[TELEMETRY_SPEED] = speed;
+  sample[TELEMETRY_POWER] = sensor_get_power();
+  sample[TELEMETRY_OP1] = control_get_output(0);
+  sample[TELEMETRY_OP2] = control_get_output(1);
+  sample[TELEMETRY_MAINS_FREQ] = static_cast<int32_t>(get_mains_freq() * 100);
+  sample[TELEMETRY_CONNECTIONS] = bluetooth_get_connections();
+  sample[TELEMETRY_OVERRIDE] =
+    (control_get_override(0) != CONTROL_AUTO)
+    | ((control_get_override(1) != CONTROL_AUTO) << 1);
+  sample[TELEMETRY_SOURCE] = sensor_get_source();
+  s->count++;
+
+  test_receive();
+}
+
+static void test_check(void) {
+  // Samples of the last, unfinished frame are not sent
+  test_stream *r = &test_received;
+  TEST_ASSERT_TRUE(r->count > (TEST_STEPS / 2));
+  for (int i = 0; i < r->count; i++) {
+    TEST_ASSERT_EQUAL_UINT32(test_sent.time[i], r->time[i]);
+    TEST_ASSERT_EQUAL_INT32_ARRAY(test_sent.samples[i], r->samples[i],
+      TELEMETRY_NUM_FIELDS);
+  }
+}
+
+static void test_power(uint32_t stamp, int power) {
+  TEST_ASSERT_EQUAL_INT(0, sensor_virtual_update(VIRTUAL_POWER, stamp, 0,
+    power, 60000));
+}
+
+void setUp(void) {
+  firmware_setup();
+  control_set_override(0, CONTROL_AUTO);
+  control_set_override(1, CONTROL_AUTO);
+  sensor_virtual_reset();
+  bluetooth_native_set_connected(false, true);
+  memset(&test_sent, 0, sizeof(test_sent));
+  memset(&test_received, 0, sizeof(test_received));
+  TEST_ASSERT_EQUAL_INT(0, telemetry_subscribe(TEST_RATE));
+}
+
+void tearDown(void) {
+  telemetry_subscribe(0);
+}
+
+void test_subscribe_rate(void) {
+  TEST_ASSERT_EQUAL_INT(-127, telemetry_subscribe(TELEMETRY_RATE_MAX + 1));
+  TEST_ASSERT_EQUAL_INT(0, telemetry_subscribe(TELEMETRY_RATE_MIN));
+  TEST_ASSERT_EQUAL_INT(0, telemetry_subscribe(0));
+}
+
+void test_round_trip(void) {
+  // A ride with the odd manual override
+  for (int i = 0; i < TEST_STEPS; i++) {
+    float speed = 0.1 * i;
+    control_update(speed);
+    if ((i % 50) == 25) {
+      control_set_override(1, i);
+      control_apply();
+    } else if ((i % 50) == 40) {
+      control_set_override(1, CONTROL_AUTO);
+      control_apply();
+    }
+    test_power(i, 100 + (i % 7) * 10);
+    test_step(static_cast<int32_t>(speed * 100));
+  }
+
+  test_check();
+  TEST_ASSERT_TRUE(test_received.frames > 1);
+}
+
+void test_worst_case(void) {
+  // Every field swings as far as it can between samples
+  for (int i = 0; i < TEST_STEPS; i++) {
+    bool odd = i & 1;
+    control_update(odd ? 1e9 : -1e9);
+    control_set_override(0, odd ? 255 : 0);
+    control_set_override(1, odd ? CONTROL_AUTO : 0);
+    control_apply();
+    bluetooth_native_set_connected(odd, true);
+    test_power(i, odd ? INT32_MIN : INT32_MAX / 2);
+    test_step(odd ? TELEMETRY_FIXED_MAX : -TELEMETRY_FIXED_MAX);
+  }
+
+  test_check();
+  TEST_ASSERT_LESS_OR_EQUAL(TELEMETRY_MAX_SAMPLE, test_received.max_sample);
+  TEST_ASSERT_LESS_OR_EQUAL(CMD_MAX_PAYLOAD, test_received.max_frame);
+}
+
+void test_speed_clamped(void) {
+  for (int i = 0; i < TEST_STEPS; i++) {
+    control_update((i & 1) ? NAN : -INFINITY);
+    test_step((i & 1) ? 0 : -TELEMETRY_FIXED_MAX);
+  }
+
+  test_check();
+}
+
+int main(int argc, char **argv) {
+  (void) argc;
+  (void) argv;
+
+  UNITY_BEGIN();
+  RUN_TEST(test_subscribe_rate);
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_worst_case);
+  RUN_TEST(test_speed_clamped);
+  return UNITY_END();
+}
@@ -0,0 +1,246 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Stuart Wilkins
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Framing of uart_cmd.h: replies, CRC checks and resync on the host
+// build. Run with "pio test -e native".
+
+#include <unity.h>
+#include "hal.h"
+#include "crc.h"
+#include "control.h"
+#include "uart_cmd.h"
+#include "native/bluetooth_native.h"
+#include "native/firmware.h"
+
+typedef struct {
+  uint8_t opcode;
+  uint8_t seq;
+  uint8_t len;
+  uint8_t payload[CMD_MAX_PAYLOAD];
+} test_reply;
+
+static int test_frame(uint8_t *buf, uint8_t opcode, uint8_t seq,
+                      const uint8_t *data, int len) {
+  buf[0] = CMD_SYNC;
+  buf[1] = opcode;
+  buf[2] = seq;
+  buf[3] = len;
+  memcpy(&buf[CMD_HEADER_LEN], data, len);
+  uint16_t crc = crc16(&buf[1], CMD_HEADER_LEN - 1 + len);
+  buf[CMD_HEADER_LEN + len] = crc & 0xFF;
+  buf[CMD_HEADER_LEN + len + 1] = crc >> 8;
+  return CMD_HEADER_LEN + len + CMD_CRC_LEN;
+}
+
+static void test_rx(const uint8_t *buf, int len) {
+  TEST_ASSERT_EQUAL_INT(len, bluetooth_native_uart_rx(buf, len));
+  uart_cmd_loop();
+}
+
+static bool test_read_reply(test_reply *reply) {
+  // Next reply sent by the device, which must have a valid CRC
+  uint8_t buf[CMD_HEADER_LEN + CMD_MAX_PAYLOAD + CMD_CRC_LEN];
+  if (bluetooth_native_uart_tx(buf, CMD_HEADER_LEN) != CMD_HEADER_LEN) {
+    return false;
+  }
+  TEST_ASSERT_EQUAL_HEX8(CMD_SYNC, buf[0]);
+
+  int len = buf[3];
+  TEST_ASSERT_EQUAL_INT(len + CMD_CRC_LEN,
+    bluetooth_native_uart_tx(&buf[CMD_HEADER_LEN], len + CMD_CRC_LEN));
+  uint16_t crc = buf[CMD_HEADER_LEN + len]
+    | (buf[CMD_HEADER_LEN + len + 1] << 8);
+  TEST_ASSERT_EQUAL_HEX16(crc16(&buf[1], CMD_HEADER_LEN - 1 + len), crc);
+
+  reply->opcode = buf[1];
+  reply->seq = buf[2];
+  reply->len = len;
+  memcpy(reply->payload, &buf[CMD_HEADER_LEN], len);
+  return true;
+}
+
+void setUp(void) {
+  firmware_setup();
+  bluetooth_native_set_connected(false, true);
+}
+
+void tearDown(void) {
+}
+
+void test_crc16_check_value(void) {
+  // CRC-16/CCITT-FALSE
+  const uint8_t check[] = "123456789";
+  TEST_ASSERT_EQUAL_HEX16(0x29B1, crc16(check, 9));
+}
+
+void test_ping_reply(void) {
+  uint8_t buf[16];
+  test_rx(buf, test_frame(buf, CMD_PING, 7, NULL, 0));
+
+  test_reply reply;
+  TEST_ASSERT_TRUE(test_read_reply(&reply));
+  TEST_ASSERT_EQUAL_HEX8(CMD_PING | CMD_REPLY, reply.opcode);
+  TEST_ASSERT_EQUAL_UINT8(7, reply.seq);
+  TEST_ASSERT_EQUAL_UINT8(1, reply.len);
+  TEST_ASSERT_EQUAL_HEX8(CMD_OK, reply.payload[0]);
+  TEST_ASSERT_FALSE(test_read_reply(&reply));
+}
+
+void test_unknown_opcode(void) {
+  uint8_t buf[16];
+  test_rx(buf, test_frame(buf, 0x7F, 1, NULL, 0));
+
+  test_reply reply;
+  TEST_ASSERT_TRUE(test_read_reply(&reply));
+  TEST_ASSERT_EQUAL_HEX8(0x7F | CMD_REPLY, reply.opcode);
+  TEST_ASSERT_EQUAL_HEX8(CMD_ERR_OPCODE, reply.payload[0]);
+}
+
+void test_frame_split_over_writes(void) {
+  uint8_t buf[16];
+  const uint8_t rate = 0;
+  int len = test_frame(buf, CMD_TELEMETRY, 3, &rate, 1);
+
+  test_reply reply;
+  test_rx(buf, 3);
+  TEST_ASSERT_FALSE(test_read_reply(&reply));
+  test_rx(&buf[3], len - 3);
+  TEST_ASSERT_TRUE(test_read_reply(&reply));
+  TEST_ASSERT_EQUAL_UINT8(3, reply.seq);
+  TEST_ASSERT_EQUAL_HEX8(CMD_OK, reply.payload[0]);
+}
+
+void test_pipelined_frames(void) {
+  uint8_t buf[32];
+  int len = test_frame(buf, CMD_PING, 1, NULL, 0);
+  len += test_frame(&buf[len], CMD_PING, 2, NULL, 0);
+  test_rx(buf, len);
+
+  test_reply reply;
+  TEST_ASSERT_TRUE(test_read_reply(&reply));
+  TEST_ASSERT_EQUAL_UINT8(1, reply.seq);
+  TEST_ASSERT_TRUE(test_read_reply(&reply));
+  TEST_ASSERT_EQUAL_UINT8(2, reply.seq);
+  TEST_ASSERT_FALSE(test_read_reply(&reply));
+}
+
+void test_bad_crc_resync(void) {
+  // A corrupt frame is skipped and the next one still parsed
+  uint8_t buf[32];
+  int len = test_frame(buf, CMD_PING, 1, NULL, 0);
+  buf[len - 1] ^= 0x01;
+  len += test_frame(&buf[len], CMD_PING, 2, NULL, 0);
+  test_rx(buf, len);
+
+  test_reply reply;
+  TEST_ASSERT_TRUE(test_read_reply(&reply));
+  TEST_ASSERT_EQUAL_UINT8(2, reply.seq);
+  TEST_ASSERT_FALSE(test_read_reply(&reply));
+}
+
+void test_corrupt_payload_resync(void) {
+  uint8_t buf[32];
+  const uint8_t rate = 0;
+  int len = test_frame(buf, CMD_TELEMETRY, 1, &rate, 1);
+  buf[CMD_HEADER_LEN] ^= 0x10;
+  len += test_frame(&buf[len], CMD_PING, 2, NULL, 0);
+  test_rx(buf, len);
+
+  test_reply reply;
+  TEST_ASSERT_TRUE(test_read_reply(&reply));
+  TEST_ASSERT_EQUAL_HEX8(CMD_PING | CMD_REPLY, reply.opcode);
+  TEST_ASSERT_EQUAL_UINT8(2, reply.seq);
+  TEST_ASSERT_FALSE(test_read_reply(&reply));
+}
+
+void test_garbage_resync(void) {
+  // Noise, including a sync byte with an impossible length
+  uint8_t buf[32];
+  const uint8_t noise[] = {0x00, 0x13, CMD_SYNC, 0x01, 0x02, 0xFF, 0x5A};
+  memcpy(buf, noise, sizeof(noise));
+  int len = sizeof(noise);
+  len += test_frame(&buf[len], CMD_PING, 9, NULL, 0);
+  test_rx(buf, len);
+
+  test_reply reply;
+  TEST_ASSERT_TRUE(test_read_reply(&reply));
+  TEST_ASSERT_EQUAL_UINT8(9, reply.seq);
+  TEST_ASSERT_FALSE(test_read_reply(&reply));
+}
+
+void test_length_checked(void) {
+  // A well framed command with the wrong payload length
+  uint8_t buf[16];
+  const uint8_t data[2] = {0, 0};
+  test_rx(buf, test_frame(buf, CMD_FAN_OVERRIDE, 4, data, sizeof(data)));
+
+  test_reply reply;
+  TEST_ASSERT_TRUE(test_read_reply(&reply));
+  TEST_ASSERT_EQUAL_HEX8(CMD_ERR_LENGTH, reply.payload[0]);
+}
+
+static uint8_t test_fan_override(uint8_t fan, int16_t level) {
+  uint8_t buf[16];
+  const uint8_t data[3] = {fan, static_cast<uint8_t>(level & 0xFF),
+                           static_cast<uint8_t>((level >> 8) & 0xFF)};
+  test_rx(buf, test_frame(buf, CMD_FAN_OVERRIDE, 5, data, sizeof(data)));
+
+  test_reply reply;
+  TEST_ASSERT_TRUE(test_read_reply(&reply));
+  TEST_ASSERT_EQUAL_HEX8(CMD_FAN_OVERRIDE | CMD_REPLY, reply.opcode);
+  return reply.payload[0];
+}
+
+void test_fan_override_range(void) {
+  TEST_ASSERT_EQUAL_HEX8(CMD_OK, test_fan_override(1, 100));
+  TEST_ASSERT_EQUAL_INT(100, control_get_override(1));
+
+  // Out of range levels leave the override as it was
+  TEST_ASSERT_EQUAL_HEX8(CMD_ERR_VALUE, test_fan_override(1, -2));
+  TEST_ASSERT_EQUAL_HEX8(CMD_ERR_VALUE, test_fan_override(1, INT16_MIN));
+  TEST_ASSERT_EQUAL_HEX8(CMD_ERR_VALUE, test_fan_override(1, 256));
+  TEST_ASSERT_EQUAL_HEX8(CMD_ERR_VALUE, test_fan_override(2, 0));
+  TEST_ASSERT_EQUAL_INT(100, control_get_override(1));
+
+  TEST_ASSERT_EQUAL_HEX8(CMD_OK, test_fan_override(1, CONTROL_AUTO));
+  TEST_ASSERT_EQUAL_INT(CONTROL_AUTO, control_get_override(1));
+}
+
+int main(int argc, char **argv) {
+  (void) argc;
+  (void) argv;
+
+  UNITY_BEGIN();
+  RUN_TEST(test_crc16_check_value);
+  RUN_TEST(test_ping_reply);
+  RUN_TEST(test_unknown_opcode);
+  RUN_TEST(test_frame_split_over_writes);
+  RUN_TEST(test_pipelined_frames);
+  RUN_TEST(test_bad_crc_resync);
+  RUN_TEST(test_corrupt_payload_resync);
+  RUN_TEST(test_garbage_resync);
+  RUN_TEST(test_length_checked);
+  RUN_TEST(test_fan_override_range);
+  return UNITY_END();
+}
@@ -0,0 +1,146 @@
+"""Convert binary ride logs (RIDEnnnn.BIN) to CSV or Parquet.
+
+The log is a sequence of 4 kB sectors, each with a 20 byte header
+followed by 16 byte records (see src/ridelog.h). Reading stops at the
+first sector which is unused, corrupt, out of sequence or left from
+another session (version 1 logs have no session nonce). Sensor traces
+(TRACnnnn.BIN) have the same layout with 32 byte records and are
+converted to the arrival time, type and payload of each notification.
+"""
+
+import argparse
+import binascii
+import csv
+import os
+import struct
+import sys
+
+SECTOR_SIZE = 4096
+MAGIC = 0x4C525346
+TRACE_MAGIC = 0x54525346
+
+# Version 1 has no session nonce
+HEADERS = {1: struct.Struct("<IBBHII"), 2: struct.Struct("<IBBHIII")}
+RECORD = struct.Struct("<IHhBBBBHBB")
+
+FIELDS = ["time", "speed", "power", "cadence", "op1", "op2", "source",
+          "mains_freq", "override"]
+
+TRACE = struct.Struct("<IBB26s")
+TRACE_FIELDS = ["time", "type", "data"]
+TRACE_TYPES = {1: "csc", 2: "cps"}
+
+
+def read_sectors(data, magic=MAGIC, record=RECORD):
+    first = None
+    for sequence, offset in enumerate(range(0, len(data), SECTOR_SIZE)):
+        sector = data[offset:offset + SECTOR_SIZE]
+        if len(sector) < 6:
+            return
+
+        sector_magic, version = struct.unpack_from("<IB", sector)
+        if sector_magic != magic:
+            return
+        if first is None:
+            if version not in HEADERS:
+                raise ValueError("Unsupported log version {}".format(version))
+        elif version != first[0]:
+            return
+
+        header = HEADERS[version]
+        if len(sector) < header.size:
+            return
+        fields = header.unpack_from(sector)
+        record_size, count, seq, crc = fields[2], fields[3], fields[4], \
+            fields[-1]
+        session = fields[5] if version >= 2 else None
+        if seq != sequence:
+            return
+        if first is None:
+            if record_size != record.size:
+                raise ValueError("Unsupported record size {}".format(
+                    record_size))
+            first = (version, session)
+        elif session != first[1]:
+            # Left in the file's clusters by an earlier session
+            return
+
+        end = header.size + count * record.size
+        check = binascii.crc32(sector[:header.size - 4])
+        check = binascii.crc32(sector[header.size:end], check)
+        if check != crc:
+            print("CRC error in sector {}".format(sequence), file=sys.stderr)
+            return
+
+        yield sector[header.size:end], count
+
+
+def read_trace(data):
+    # Arrival times are micros() on the device, which wraps
+    rows = []
+    last = None
+    elapsed = 0
+    for records, count in read_sectors(data, TRACE_MAGIC, TRACE):
+        for i in range(count):
+            time, kind, length, payload = \
+                TRACE.unpack_from(records, i * TRACE.size)
+            if last is not None:
+                elapsed += (time - last) & 0xFFFFFFFF
+            last = time
+            rows.append([elapsed / 1e6, TRACE_TYPES.get(kind, kind),
+                         payload[:length].hex()])
+
+    return rows
+
+
+def read_log(filename):
+    """Return the field names and rows of a ride log or trace."""
+    with open(filename, "rb") as f:
+        data = f.read()
+
+    if len(data) >= 4 and struct.unpack_from("<I", data)[0] == TRACE_MAGIC:
+        return TRACE_FIELDS, read_trace(data)
+
+    rows = []
+    for records, count in read_sectors(data):
+        for i in range(count):
+            (time, speed, power, cadence, op1, op2, source, mains_freq,
+             override, _) = RECORD.unpack_from(records, i * RECORD.size)
+            rows.append([time / 1000, speed / 100, power, cadence, op1,
+                         op2, source, mains_freq / 100, override])
+
+    return FIELDS, rows
+
+
+def write_csv(filename, fields, rows):
+    with open(filename, "w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow(fields)
+        writer.writerows(rows)
+
+
+def write_parquet(filename, fields, rows):
+    import pandas as pd
+    pd.DataFrame(rows, columns=fields).to_parquet(filename)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("files", nargs="+", help="Ride log files")
+    parser.add_argument("--parquet", action="store_true",
+                        help="Write Parquet instead of CSV")
+    args = parser.parse_args()
+
+    for filename in args.files:
+        fields, rows = read_log(filename)
+        ext = ".parquet" if args.parquet else ".csv"
+        output = os.path.splitext(filename)[0] + ext
+        if args.parquet:
+            write_parquet(output, fields, rows)
+        else:
+            write_csv(output, fields, rows)
+        print("{} : {} records -> {}".format(filename, len(rows), output))
+
+
+if __name__ == "__main__":
+    main()